@@ -0,0 +1,161 @@
+#include "bench.h"
+#include "group_if.h"
+#include "trigram.h"
+#include "util.h"
+#include "views.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Бенчмарки - в отдельной единице трансляции: в большой main.cpp компилятор упирается в пределы
+// роста кода и перестаёт встраивать шаги конвейера адаптеров, а измерять нужно сам конвейер
+
+using trigram::is_letter;
+
+namespace {
+
+// Триграммы разбора, свёрнутые в число и сумму: бенчмарк сравнивает разбор, а не таблицу
+struct Checksum {
+  size_t count = 0;
+  uint64_t sum = 0;
+
+  void operator()(uint64_t value) noexcept { ++count; sum += value; }
+  bool operator==(const Checksum&) const = default;
+};
+
+// Ленивые адаптеры
+Checksum views_checksum(std::string_view input) {
+  // Лямбда, а не указатель на функцию: предикат вызывается напрямую, как в цикле
+  const auto letter = [](uu::UnicodeCodePoint code_point) { return is_letter(code_point); };
+  Checksum checksum;
+  for (auto value : input | uu::views::utf8_decode | uu::views::words(letter) | trigram::views::trigrams) {
+    checksum(value);
+  }
+  return checksum;
+}
+
+// Тот же разбор циклом вручную
+Checksum loop_checksum(std::string_view input) {
+  Checksum checksum;
+  std::vector<uu::UnicodeCodePoint> word;
+  auto flush = [&] {
+    if (not word.empty()) {
+      trigram::for_each_trigram(word, std::ref(checksum));
+      word.clear();
+    }
+  };
+  auto first = reinterpret_cast<const uint8_t*>(input.data());
+  const auto last = first + input.size();
+  while (first != last) {
+    const auto [next, code_point, valid] = uu::decode_utf8_char(first, last);
+    first = next;
+    if (is_letter(code_point)) {
+      word.push_back(code_point);
+    } else {
+      flush();
+    }
+  }
+  flush();
+  return checksum;
+}
+
+// Векторный разбор, как при подсчёте
+Checksum fused_checksum(std::string_view input) {
+  Checksum checksum;
+  uu::for_each_group(cbegin(input), cend(input), is_letter, [&](std::span<const uu::UnicodeCodePoint> word) {
+    trigram::for_each_trigram(word, std::ref(checksum));
+  });
+  return checksum;
+}
+
+} // namespace
+
+void bench_decoder(std::string_view input, unsigned repeats) {
+  auto first = reinterpret_cast<const uint8_t*>(input.data());
+  auto last = first + input.size();
+  std::vector<uu::UnicodeCodePoint> scalar(input.size() + 16);
+  std::vector<uu::UnicodeCodePoint> vector(input.size() + 16);
+
+  auto measure = [&](auto decode) {
+    unsigned best = std::numeric_limits<unsigned>::max();
+    size_t decoded = 0;
+    for (unsigned i = 0; i < repeats; ++i) {
+      Timer t; t.start();
+      decoded = decode();
+      t.stop();
+      best = std::min(best, t.elapsed_ms());
+    }
+    const auto mb_per_s = static_cast<double>(input.size()) / (1 << 20) * 1000 / std::max(1u, best);
+    return std::pair{decoded, std::pair{best, mb_per_s}};
+  };
+
+  auto [scalar_size, scalar_time] = measure([&] {
+    auto out = scalar.data();
+    auto push = [&out](uu::UnicodeCodePoint code_point) { *out++ = code_point; };
+    uu::decode_block<uu::Engine::Utf8>(first, last, last, push);
+    return static_cast<size_t>(out - scalar.data());
+  });
+  auto [vector_size, vector_time] = measure([&] {
+    return static_cast<size_t>(uu::transcode_utf8(first, last, last, vector.data()).out - vector.data());
+  });
+
+  std::cout << "Code points: " << scalar_size << '\n';
+  std::cout << "Scalar: " << scalar_time.first << " ms (" << std::fixed << std::setprecision(1)
+            << scalar_time.second << " MB/s)\n";
+  std::cout << "Vector: " << vector_time.first << " ms (" << vector_time.second << " MB/s)\n";
+  if (scalar_size != vector_size || not std::equal(scalar.data(), scalar.data() + scalar_size, vector.data())) {
+    throw std::runtime_error("Vector decoder output differs from the scalar decoder");
+  }
+
+  // Проверка и декодер без проверок: вместе они заменяют проверяющий декодер
+  auto [invalid, validate_time] = measure([&] { return uu::validate_utf8(input); });
+  std::cout << "Validate: " << validate_time.first << " ms (" << validate_time.second << " MB/s)\n";
+  if (invalid != input.size()) {
+    std::cout << "Invalid utf-8 at byte " << invalid << ", unchecked decoder skipped\n";
+    return;
+  }
+  auto [unchecked_size, unchecked_time] = measure([&] {
+    return static_cast<size_t>(uu::transcode_valid(first, last, vector.data()).out - vector.data());
+  });
+  std::cout << "Unchecked: " << unchecked_time.first << " ms (" << unchecked_time.second << " MB/s)\n";
+  if (scalar_size != unchecked_size || not std::equal(scalar.data(), scalar.data() + scalar_size, vector.data())) {
+    throw std::runtime_error("Unchecked decoder output differs from the scalar decoder");
+  }
+}
+
+void bench_views(std::string_view input, unsigned repeats) {
+  auto measure = [&](auto count) {
+    unsigned best = std::numeric_limits<unsigned>::max();
+    Checksum checksum;
+    for (unsigned i = 0; i < repeats; ++i) {
+      Timer t; t.start();
+      checksum = count(input);
+      t.stop();
+      best = std::min(best, t.elapsed_ms());
+    }
+    const auto mb_per_s = static_cast<double>(input.size()) / (1 << 20) * 1000 / std::max(1u, best);
+    return std::pair{checksum, std::pair{best, mb_per_s}};
+  };
+
+  auto [views_sum, views_time] = measure(views_checksum);
+  auto [loop_sum, loop_time] = measure(loop_checksum);
+  auto [fused_sum, fused_time] = measure(fused_checksum);
+
+  std::cout << "Trigrams: " << views_sum.count << '\n';
+  std::cout << "Views: " << views_time.first << " ms (" << std::fixed << std::setprecision(1)
+            << views_time.second << " MB/s)\n";
+  std::cout << "Loop: " << loop_time.first << " ms (" << loop_time.second << " MB/s)\n";
+  std::cout << "Fused: " << fused_time.first << " ms (" << fused_time.second << " MB/s)\n";
+  if (views_sum != loop_sum || views_sum != fused_sum) {
+    throw std::runtime_error("Range adaptors produced different trigrams than the loops");
+  }
+}
+
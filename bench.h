@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string_view>
+
+/**
+ * @brief Сравнивает скалярный декодер (decode_block<Engine::Utf8>) с векторным transcode_utf8
+ *
+ * Оба декодера пишут code points всего входа в один заранее выделенный буфер,
+ * из repeats прогонов берётся лучшее время. Результаты сравниваются поэлементно.
+ */
+void bench_decoder(std::string_view input, unsigned repeats);
+
+/**
+ * @brief Сравнивает конвейер ленивых адаптеров utf8_decode | words | trigrams с тем же разбором
+ *        циклом вручную и с векторным разбором for_each_group
+ *
+ * Считается только разбор: триграммы сворачиваются в число и сумму, которые должны совпасть.
+ * Из repeats прогонов берётся лучшее время.
+ *
+ * Равенства с циклом адаптеры не обещают (см. uu::views): на input.txt они равны, на трёхбайтном
+ * тексте медленнее. Для подсчёта конвейер не используется, там работает for_each_group.
+ */
+void bench_views(std::string_view input, unsigned repeats);
@@ -0,0 +1,77 @@
+#include "corpus.h"
+#include "decompress.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+void collect(const std::filesystem::path& root, std::vector<io::FileRange>& files) {
+  namespace fs = std::filesystem;
+
+  auto add = [&files](const fs::directory_entry& entry) {
+    if (entry.is_regular_file()) {
+      if (auto size = entry.file_size(); size != 0) {
+        files.push_back({entry.path(), 0, size, size});
+      }
+    }
+  };
+
+  fs::directory_entry entry(root);
+  if (not entry.is_directory()) {
+    if (not entry.exists()) {
+      throw std::runtime_error("No such file or directory: " + root.string());
+    }
+    add(entry);
+    return;
+  }
+
+  for (const auto& child : fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied)) {
+    add(child);
+  }
+}
+
+} // namespace
+
+std::vector<io::CorpusTask> io::plan_corpus(const std::vector<std::filesystem::path>& roots, size_t batch_size,
+                                            size_t split_size) {
+  std::vector<FileRange> files;
+  for (const auto& root : roots) {
+    collect(root, files);
+  }
+
+  std::vector<CorpusTask> tasks;
+  CorpusTask batch;
+  size_t batch_bytes = 0;
+  for (auto& file : files) {
+    // Сжатый поток нельзя начать читать с середины, такие файлы не режем
+    if (file.file_size > split_size && io::detect_compression(file.path) == Compression::None) {
+      for (size_t begin = 0; begin < file.file_size; begin += split_size) {
+        tasks.push_back({{file.path, begin, std::min(begin + split_size, file.file_size), file.file_size}});
+      }
+      continue;
+    }
+
+    batch_bytes += file.file_size;
+    batch.push_back(std::move(file));
+    if (batch_bytes >= batch_size) {
+      tasks.push_back(std::exchange(batch, {}));
+      batch_bytes = 0;
+    }
+  }
+  if (not batch.empty()) {
+    tasks.push_back(std::move(batch));
+  }
+
+  // Крупные задачи вперёд: меньше простоя потоков в конце
+  std::ranges::stable_sort(tasks, std::greater{}, [](const CorpusTask& task) {
+    size_t bytes = 0;
+    for (const auto& range : task) {
+      bytes += range.end - range.begin;
+    }
+    return bytes;
+  });
+  return tasks;
+}
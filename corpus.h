@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace io {
+
+/// Диапазон байт [begin, end) одного файла корпуса
+struct FileRange {
+  std::filesystem::path path;
+  size_t begin = 0;
+  size_t end = 0;
+  size_t file_size = 0;
+};
+
+/// Единица работы для одного потока: несколько мелких файлов либо часть крупного
+using CorpusTask = std::vector<FileRange>;
+
+/**
+ * @brief Собирает файлы корпуса и раскладывает их на задачи примерно равного объёма
+ *
+ * Каталоги обходятся рекурсивно, учитываются только обычные непустые файлы.
+ * Файлы меньше batch_size объединяются в одну задачу, пока её объём не достигнет batch_size.
+ * Несжатые файлы больше split_size режутся на диапазоны по split_size байт; границы диапазонов
+ * заданы в байтах, выравнивание по словам выполняет исполнитель задачи.
+ *
+ * @param roots Файлы и каталоги
+ * @param batch_size Целевой объём задачи из мелких файлов
+ * @param split_size Максимальный объём диапазона крупного файла
+ */
+[[nodiscard]] std::vector<CorpusTask> plan_corpus(const std::vector<std::filesystem::path>& roots, size_t batch_size,
+                                                  size_t split_size);
+
+} // namespace io
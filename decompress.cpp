@@ -0,0 +1,263 @@
+#include "decompress.h"
+#include "tsqueue.h"
+
+#include <array>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef TRIGRAM_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TRIGRAM_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// Буфер кольца: номер и объём полезных данных
+struct Block {
+  unsigned slot = 0;
+  size_t size = 0;
+
+  bool operator==(const Block&) const = default;
+};
+
+constexpr Block EndOfStream{std::numeric_limits<unsigned>::max(), 0};
+
+} // namespace
+
+template <> Block ts::Limiter<Block>() { return EndOfStream; }
+
+struct io::DecompressReader::Pipeline {
+  std::FILE* file = nullptr;
+  size_t chunk_size = 0;
+  std::vector<std::string> buffers;
+  // Свободные буферы идут от потребителя к распаковщику, заполненные - обратно
+  ts::TSQueue<Block> free;
+  ts::TSQueue<Block> filled;
+  std::atomic<bool> cancelled{false};
+  std::exception_ptr error;
+  std::optional<unsigned> current;
+  bool done = false;
+  std::thread worker;
+
+  ~Pipeline() {
+    if (worker.joinable()) {
+      cancelled = true;
+      free.push(EndOfStream);
+      worker.join();
+    }
+    if (file != nullptr) {
+      std::fclose(file);
+    }
+  }
+
+  // Берёт свободный буфер; false, если потребитель закрыл конвейер
+  bool acquire(Block& out) {
+    if (cancelled || !free.wait_and_pop(out)) {
+      return false;
+    }
+    out.size = 0;
+    return true;
+  }
+
+  // Отдаёт заполненный буфер потребителю и берёт следующий
+  bool emit(Block& out) {
+    filled.push(out);
+    return acquire(out);
+  }
+
+  char* data(const Block& out) { return buffers[out.slot].data(); }
+
+  size_t read(std::vector<unsigned char>& input) {
+    auto n = std::fread(input.data(), 1, input.size(), file);
+    if (n == 0 && std::ferror(file)) {
+      throw std::runtime_error("Failed to read compressed file");
+    }
+    return n;
+  }
+
+  void run(Compression compression) {
+    try {
+      switch (compression) {
+        case Compression::Gzip: inflate_gzip(); break;
+        case Compression::Zstd: decompress_zstd(); break;
+        case Compression::None: break;
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+    filled.push(EndOfStream);
+  }
+
+  void inflate_gzip() {
+#ifdef TRIGRAM_HAS_ZLIB
+    struct Stream : z_stream {
+      Stream() : z_stream{} {
+        // 15 + 32: окно 32 КБ и автоопределение заголовка gzip/zlib
+        if (inflateInit2(this, 15 + 32) != Z_OK) {
+          throw std::runtime_error("Failed to initialize zlib");
+        }
+      }
+      ~Stream() { inflateEnd(this); }
+    } stream;
+
+    std::vector<unsigned char> input(chunk_size);
+    Block out;
+    if (!acquire(out)) { return; }
+
+    bool drained = true;      // распаковщик отдал всё, что мог, из текущего входа
+    bool member_end = false;  // закончился очередной член gzip
+    while (true) {
+      if (stream.avail_in == 0 && drained) {
+        auto n = read(input);
+        if (n == 0) { break; }
+        stream.next_in = input.data();
+        stream.avail_in = static_cast<uInt>(n);
+      }
+      if (member_end) {
+        // Файлы pigz и cat a.gz b.gz состоят из нескольких членов подряд
+        inflateReset(&stream);
+        member_end = false;
+      }
+
+      stream.next_out = reinterpret_cast<Bytef*>(data(out) + out.size);
+      stream.avail_out = static_cast<uInt>(chunk_size - out.size);
+      auto rc = inflate(&stream, Z_NO_FLUSH);
+      if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+        throw std::runtime_error("Corrupted gzip stream");
+      }
+      drained = stream.avail_out != 0;
+      member_end = rc == Z_STREAM_END;
+      out.size = chunk_size - stream.avail_out;
+
+      if (out.size == chunk_size && !emit(out)) { return; }
+    }
+    if (!member_end && stream.total_in != 0) {
+      throw std::runtime_error("Unexpected end of gzip stream");
+    }
+    if (out.size != 0) {
+      filled.push(out);
+    }
+#else
+    throw std::runtime_error("gzip support is not compiled in (zlib was not found)");
+#endif
+  }
+
+  void decompress_zstd() {
+#ifdef TRIGRAM_HAS_ZSTD
+    std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+    if (!stream) {
+      throw std::runtime_error("Failed to initialize zstd");
+    }
+    ZSTD_initDStream(stream.get());
+
+    std::vector<unsigned char> input(chunk_size);
+    ZSTD_inBuffer in{input.data(), 0, 0};
+    Block out;
+    if (!acquire(out)) { return; }
+
+    bool drained = true;
+    size_t hint = 0;  // 0 - кадр zstd завершён
+    while (true) {
+      if (in.pos == in.size && drained) {
+        auto n = read(input);
+        if (n == 0) { break; }
+        in = {input.data(), n, 0};
+      }
+
+      ZSTD_outBuffer output{data(out) + out.size, chunk_size - out.size, 0};
+      hint = ZSTD_decompressStream(stream.get(), &output, &in);
+      if (ZSTD_isError(hint)) {
+        throw std::runtime_error(std::string("Corrupted zstd stream: ") + ZSTD_getErrorName(hint));
+      }
+      drained = output.pos < output.size;
+      out.size += output.pos;
+
+      if (out.size == chunk_size && !emit(out)) { return; }
+    }
+    if (hint != 0) {
+      throw std::runtime_error("Unexpected end of zstd stream");
+    }
+    if (out.size != 0) {
+      filled.push(out);
+    }
+#else
+    throw std::runtime_error("zstd support is not compiled in (libzstd was not found)");
+#endif
+  }
+};
+
+io::Compression io::detect_compression(const std::filesystem::path& path) {
+  std::FILE* file = std::fopen(path.string().c_str(), "rb");
+  if (file == nullptr) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  std::array<char, 4> magic{};
+  auto n = std::fread(magic.data(), 1, magic.size(), file);
+  std::fclose(file);
+  return detect_compression(std::string_view(magic.data(), n));
+}
+
+io::Compression io::detect_compression(std::string_view head) {
+  if (head.starts_with("\x1F\x8B")) {
+    return Compression::Gzip;
+  }
+  if (head.starts_with("\x28\xB5\x2F\xFD")) {
+    return Compression::Zstd;
+  }
+  return Compression::None;
+}
+
+io::DecompressReader::DecompressReader(const std::filesystem::path& path, Compression compression,
+                                       size_t chunk_size, unsigned buffers)
+    : pipeline_(std::make_unique<Pipeline>()) {
+  if (chunk_size == 0 || buffers == 0) {
+    throw std::invalid_argument("Chunk size and buffer count must be positive");
+  }
+  pipeline_->file = std::fopen(path.string().c_str(), "rb");
+  if (pipeline_->file == nullptr) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  std::setvbuf(pipeline_->file, nullptr, _IONBF, 0);
+
+  pipeline_->chunk_size = chunk_size;
+  pipeline_->buffers.resize(buffers);
+  for (unsigned slot = 0; slot < buffers; ++slot) {
+    pipeline_->buffers[slot].resize(chunk_size);
+    pipeline_->free.push({slot, 0});
+  }
+  pipeline_->worker = std::thread([pipeline = pipeline_.get(), compression] { pipeline->run(compression); });
+}
+
+io::DecompressReader::~DecompressReader() = default;
+
+std::string_view io::DecompressReader::next() {
+  auto& pipeline = *pipeline_;
+  if (pipeline.done) {
+    return {};
+  }
+  if (pipeline.current) {
+    pipeline.free.push({*pipeline.current, 0});
+    pipeline.current.reset();
+  }
+
+  Block block;
+  if (!pipeline.filled.wait_and_pop(block)) {
+    pipeline.done = true;
+    pipeline.worker.join();
+    if (pipeline.error) {
+      std::rethrow_exception(pipeline.error);
+    }
+    return {};
+  }
+  pipeline.current = block.slot;
+  consumed_ += block.size;
+  return {pipeline.buffers[block.slot].data(), block.size};
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+namespace io {
+
+enum class Compression { None, Gzip, Zstd };
+
+/// Определяет сжатие по сигнатуре первых байт файла
+[[nodiscard]] Compression detect_compression(const std::filesystem::path& path);
+/// То же по уже прочитанному началу файла
+[[nodiscard]] Compression detect_compression(std::string_view head);
+
+/**
+ * @brief Чтение сжатого файла (gzip, zstd) с распаковкой в отдельном потоке
+ *
+ * Поток распаковки заполняет кольцо из buffers буферов по chunk_size байт,
+ * потребитель забирает готовые блоки через next() и возвращает буфер в кольцо
+ * следующим вызовом next(). Так распаковка идёт параллельно с подсчётом триграмм
+ * без внешнего канала и лишнего копирования.
+ *
+ * Поддержка форматов зависит от найденных при конфигурации zlib и libzstd;
+ * для неподдержанного формата конструктор бросает исключение.
+ */
+class DecompressReader final {
+public:
+  DecompressReader(const std::filesystem::path& path, Compression compression, size_t chunk_size,
+                   unsigned buffers = 4);
+  ~DecompressReader();
+
+  DecompressReader(const DecompressReader&) = delete;
+  DecompressReader& operator=(const DecompressReader&) = delete;
+
+  /// Следующий распакованный блок; пустой блок означает конец входа
+  [[nodiscard]] std::string_view next();
+  /// Количество распакованных байт, отданных потребителю
+  [[nodiscard]] size_t consumed() const noexcept { return consumed_; }
+
+private:
+  struct Pipeline;
+
+  std::unique_ptr<Pipeline> pipeline_;
+  size_t consumed_ = 0;
+};
+
+} // namespace io
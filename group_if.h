@@ -1,5 +1,24 @@
 #pragma once
 
+#include "encoding.h"
+#include "letters.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
 // uu - Unicode Utilities
 namespace uu {
 
@@ -82,6 +101,803 @@ __attribute__((always_inline)) inline short get_utf8_char_len(uint8_t byte) {
 }
 
 using UnicodeCodePoint = uint32_t;
+/**
+ * @brief Декодирует одну полную последовательность utf-8
+ *
+ * @param bytes Байты последовательности, первый байт - ведущий
+ * @param length Длина последовательности, полученная get_utf8_char_len
+ * @return Code point
+ */
+__attribute__((always_inline)) inline UnicodeCodePoint decode_utf8(const uint8_t* bytes, short length) {
+  switch (length) {
+    [[likely]] case 2: return (bytes[0] & 0x1F) << 6 | (bytes[1] & 0x3F);
+    case 3: return (bytes[0] & 0x0F) << 12 | (bytes[1] & 0x3F) << 6 | (bytes[2] & 0x3F);
+    case 4: return (bytes[0] & 0x07) << 18 | (bytes[1] & 0x3F) << 12 | (bytes[2] & 0x3F) << 6 | (bytes[3] & 0x3F);
+    default: return bytes[0];
+  }
+}
+
+/// Что делать с некорректной последовательностью utf-8
+enum class OnInvalid {
+  Skip,     ///< отбросить
+  Replace,  ///< заменить на U+FFFD (одна замена на максимальную корректную часть, как в Unicode 3.9)
+  Stop      ///< остановиться, бросив InvalidUtf8
+};
+
+inline constexpr UnicodeCodePoint ReplacementCharacter = 0xFFFD;
+
+/**
+ * @brief Исключение OnInvalid::Stop: некорректная последовательность utf-8
+ *
+ * Декодер знает только адрес последовательности (position). Владелец входа пересчитывает
+ * его в смещение от начала входа через at().
+ */
+class InvalidUtf8 final : public std::runtime_error {
+public:
+  explicit InvalidUtf8(const uint8_t* position)
+      : std::runtime_error("Invalid utf-8"), position_(position) {}
+  InvalidUtf8(const uint8_t* position, size_t offset)
+      : std::runtime_error("Invalid utf-8 at byte " + std::to_string(offset)), position_(position), offset_(offset) {}
+
+  /// То же исключение со смещением position относительно начала входа base, которое находится по смещению base_offset
+  [[nodiscard]] InvalidUtf8 at(const uint8_t* base, size_t base_offset = 0) const {
+    return {position_, base_offset + static_cast<size_t>(position_ - base)};
+  }
+  /// То же исключение со смещением, сдвинутым на shift
+  [[nodiscard]] InvalidUtf8 shifted(size_t shift) const { return {position_, offset_ + shift}; }
+
+  [[nodiscard]] const uint8_t* position() const noexcept { return position_; }
+  [[nodiscard]] size_t offset() const noexcept { return offset_; }
+
+private:
+  const uint8_t* position_ = nullptr;
+  size_t offset_ = 0;
+};
+
+/**
+ * @brief Проверяющий декодер utf-8 на конечном автомате (B. Hoehrmann, "Flexible and Economical UTF-8 Decoder")
+ *
+ * Байт отображается в класс (classes), состояние и класс - в следующее состояние (transitions).
+ * Автомат отвергает overlong-формы, суррогаты, code points больше U+10FFFF,
+ * одиночные байты продолжения и оборванные последовательности.
+ */
+struct Utf8Dfa {
+  static constexpr uint8_t Accept = 0;
+  static constexpr uint8_t Reject = 12;
+
+  static constexpr std::array<uint8_t, 256> classes = [] {
+    std::array<uint8_t, 256> table{};
+    auto fill = [&table](unsigned from, unsigned to, uint8_t type) {
+      for (auto byte = from; byte <= to; ++byte) {
+        table[byte] = type;
+      }
+    };
+    fill(0x00, 0x7F, 0);   // ASCII
+    fill(0x80, 0x8F, 1);   // продолжение
+    fill(0x90, 0x9F, 9);   // продолжение
+    fill(0xA0, 0xBF, 7);   // продолжение
+    fill(0xC0, 0xC1, 8);   // overlong ASCII
+    fill(0xC2, 0xDF, 2);   // 110xxxxx
+    fill(0xE0, 0xE0, 10);  // 1110xxxx, второй байт A0..BF
+    fill(0xE1, 0xEC, 3);   // 1110xxxx
+    fill(0xED, 0xED, 4);   // 1110xxxx, второй байт 80..9F (без суррогатов)
+    fill(0xEE, 0xEF, 3);   // 1110xxxx
+    fill(0xF0, 0xF0, 11);  // 11110xxx, второй байт 90..BF
+    fill(0xF1, 0xF3, 6);   // 11110xxx
+    fill(0xF4, 0xF4, 5);   // 11110xxx, второй байт 80..8F (не больше U+10FFFF)
+    fill(0xF5, 0xFF, 8);   // не встречаются в utf-8
+    return table;
+  }();
+
+  // Строка - состояние (кратно 12), столбец - класс байта
+  static constexpr std::array<uint8_t, 108> transitions{
+       0, 12, 24, 36, 60, 96, 84, 12, 12, 12, 48, 72,  // Accept
+      12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,  // Reject
+      12,  0, 12, 12, 12, 12, 12,  0, 12,  0, 12, 12,  // нужен 1 байт продолжения
+      12, 24, 12, 12, 12, 12, 12, 24, 12, 24, 12, 12,  // нужно 2
+      12, 12, 12, 12, 12, 12, 12, 24, 12, 12, 12, 12,  // после E0
+      12, 24, 12, 12, 12, 12, 12, 12, 12, 24, 12, 12,  // после ED
+      12, 12, 12, 12, 12, 12, 12, 36, 12, 36, 12, 12,  // после F0
+      12, 36, 12, 12, 12, 12, 12, 36, 12, 36, 12, 12,  // после F1..F3
+      12, 36, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,  // после F4
+  };
+};
+
+/**
+ * @brief Декодирует [first, block_end) автоматом Utf8Dfa, записывая code points в out
+ *
+ * Каждый байт записывает текущий code point в *out, а указатель сдвигается, только если
+ * последовательность завершена: на корректном входе цикл не ветвится по длине символов.
+ * Последний символ может заканчиваться за block_end (но не за last).
+ *
+ * @param out Буфер не меньше (block_end - first) + 4 элементов, сдвигается за последний code point
+ * @return Позиция остановки: >= block_end, либо начало незавершённой последовательности в конце входа
+ * @throws InvalidUtf8 при OnInvalid::Stop
+ */
+inline const uint8_t* decode_utf8_dfa(const uint8_t* first, const uint8_t* block_end, const uint8_t* last,
+                                      UnicodeCodePoint*& out, OnInvalid policy) {
+  uint32_t state = Utf8Dfa::Accept;
+  UnicodeCodePoint code_point = 0;
+  auto start = first;  // начало текущей последовательности
+
+  while (first < block_end || state != Utf8Dfa::Accept) {
+    if (first == last) {
+      return start;
+    }
+    const auto byte = *first;
+    const auto type = Utf8Dfa::classes[byte];
+    code_point = state != Utf8Dfa::Accept ? (byte & 0x3Fu) | code_point << 6 : (0xFFu >> type) & byte;
+    state = Utf8Dfa::transitions[state + type];
+
+    if (state == Utf8Dfa::Reject) [[unlikely]] {
+      if (policy == OnInvalid::Stop) {
+        throw InvalidUtf8(start);
+      }
+      *out = ReplacementCharacter;
+      out += policy == OnInvalid::Replace;
+      // Ведущий байт пропускается, байт, прервавший последовательность, разбирается заново
+      first += first == start;
+      start = first;
+      state = Utf8Dfa::Accept;
+      continue;
+    }
+
+    ++first;
+    *out = code_point;
+    out += state == Utf8Dfa::Accept;
+    start = state == Utf8Dfa::Accept ? first : start;
+  }
+  return first;
+}
+
+/**
+ * @brief Находит первую некорректную последовательность в [first, last) автоматом Utf8Dfa
+ *
+ * ASCII пропускается словами по 8 байт.
+ *
+ * @return Начало последовательности (как у InvalidUtf8 при OnInvalid::Stop), в том числе оборванной
+ *         в конце входа, либо last
+ */
+inline const uint8_t* find_invalid_utf8(const uint8_t* first, const uint8_t* last) {
+  uint32_t state = Utf8Dfa::Accept;
+  auto start = first;
+  while (first != last) {
+    if (uint64_t word; state == Utf8Dfa::Accept && last - first >= 8) {
+      std::memcpy(&word, first, sizeof(word));
+      if ((word & 0x8080808080808080ull) == 0) {
+        first += 8;
+        start = first;
+        continue;
+      }
+    }
+    state = Utf8Dfa::transitions[state + Utf8Dfa::classes[*first]];
+    if (state == Utf8Dfa::Reject) {
+      return start;
+    }
+    ++first;
+    start = state == Utf8Dfa::Accept ? first : start;
+  }
+  return state == Utf8Dfa::Accept ? last : start;
+}
+
+/**
+ * @brief Начало символа не дальше 3 байт до pos
+ *
+ * Если вход до pos проверен, символы, начатые раньше, в нём и закончились: с найденной позиции
+ * проверку можно продолжить, не пропустив ни одной ошибки.
+ */
+inline const uint8_t* utf8_resync(const uint8_t* begin, const uint8_t* pos) {
+  auto resync = pos - std::min<ptrdiff_t>(pos - begin, 3);
+  while (resync != pos && resync != begin && (*resync & 0xC0) == 0x80) {
+    ++resync;
+  }
+  return resync;
+}
+
+/// Специализированный декодер, выбираемый по содержимому блока входа (CodePage - однобайтовые кодировки)
+enum class Engine { Ascii, TwoByte, Utf8, CodePage };
+
+constexpr std::string_view to_string(Engine engine) {
+  switch (engine) {
+    case Engine::Ascii: return "ascii";
+    case Engine::TwoByte: return "2-byte";
+    case Engine::Utf8: return "utf-8";
+    case Engine::CodePage: return "code page";
+  }
+  return {};
+}
+
+/// Объём входа, обработанный каждым декодером
+struct EngineStats {
+  std::array<size_t, 4> bytes{};
+
+  // Без проверки индекса GCC (-Warray-bounds) не доказывает, что engine не выходит за bytes
+  void add(Engine engine, size_t size) noexcept {
+    const auto index = static_cast<size_t>(engine);
+    if (index < bytes.size()) [[likely]] {
+      bytes[index] += size;
+    }
+  }
+  [[nodiscard]] Engine dominant() const noexcept {
+    return static_cast<Engine>(std::ranges::max_element(bytes) - bytes.begin());
+  }
+};
+
+/// Размер блока, для которого заново выбирается декодер
+inline constexpr size_t EngineBlockSize = 16 << 10;
+
+/// Результат transcode_utf8: где остановилось чтение входа и где закончилась запись code points
+struct TranscodeResult {
+  const uint8_t* stop;
+  UnicodeCodePoint* out;
+};
+
+/**
+ * @brief Варианты векторных ядер для одного набора инструкций
+ *
+ * Тела ядер (simd_kernels.inc) собираются в simd.cpp для каждого набора инструкций платформы:
+ * scalar, SSE4.2, AVX2, AVX-512 (BW) на x86-64, scalar и NEON на aarch64. При первом обращении
+ * kernels() выбирает лучший вариант, поддерживаемый процессором, так что один исполняемый
+ * файл работает на любой машине своей архитектуры. Описание каждого ядра - у одноимённых
+ * функций ниже.
+ *
+ * @note Генерация триграмм и подсчёт в хеш-таблице - скалярный код, ограниченный зависимыми
+ *       загрузками; их варианты не отличались бы друг от друга, поэтому в таблицу они не входят.
+ */
+struct Kernels {
+  Isa isa;
+  bool (*classify_ascii64)(const uint8_t* bytes, const AsciiSet& set, uint64_t& letters);
+  bool (*classify_code_points64)(const UnicodeCodePoint* code_points, unsigned size, const TwoByteSet& set,
+                                 uint64_t& letters);
+  Engine (*classify)(const uint8_t* first, const uint8_t* last);
+  TranscodeResult (*transcode_utf8)(const uint8_t* first, const uint8_t* block_end, const uint8_t* last,
+                                    UnicodeCodePoint* out, OnInvalid policy);
+  TranscodeResult (*transcode_two_byte)(const uint8_t* first, const uint8_t* block_end, const uint8_t* last,
+                                        UnicodeCodePoint* out, OnInvalid policy);
+  void (*fold_ascii64)(const uint8_t* bytes, uint8_t* out);
+  void (*fold_case)(UnicodeCodePoint* first, UnicodeCodePoint* last);
+  const uint8_t* (*validate_utf8)(const uint8_t* first, const uint8_t* last);
+  TranscodeResult (*transcode_valid)(const uint8_t* first, const uint8_t* block_end, UnicodeCodePoint* out);
+};
+
+/// Активный вариант ядер
+[[nodiscard]] const Kernels& kernels() noexcept;
+
+/**
+ * @brief Переключает ядра на вариант isa (для сравнения вариантов; вызывать до запуска потоков)
+ *
+ * @throws std::runtime_error если вариант не собран для этой платформы или не поддерживается процессором
+ */
+void force_isa(Isa isa);
+
+/**
+ * @brief Проверяет, что 64 байта - ASCII, и строит маску символов из set
+ *
+ * @param bytes Начало 64 байт входа
+ * @param set Множество символов группы
+ * @param[out] letters Бит i установлен, если bytes[i] входит в set (только при возврате true)
+ * @return false, если среди 64 байт есть байт >= 0x80
+ *
+ * @note AVX-512: один вектор 64 байта, AVX2: 2 x 32 байта, SSE4.2 и NEON: 4 x 16 байт
+ *       с подстановкой по полубайтам. Scalar: старший бит проверяется словами по 8 байт, маска - по таблице.
+ */
+inline bool classify_ascii64(const uint8_t* bytes, const AsciiSet& set, uint64_t& letters) {
+  return kernels().classify_ascii64(bytes, set, letters);
+}
+
+/**
+ * @brief Проверяет, что size <= 64 code points меньше U+0800, и строит маску символов из set
+ *
+ * @param code_points Начало size code points
+ * @param size Число code points, не больше 64
+ * @param set Множество символов группы
+ * @param[out] letters Бит i установлен, если code_points[i] входит в set (только при возврате true)
+ * @return false, если среди code points есть >= U+0800
+ *
+ * @note AVX-512: 4 x 16 code points, AVX2: 8 x 8, бит множества выбирается gather по 32-битным словам.
+ *       Остальные варианты: диапазон - векторизуемой редукцией, маска - из байт умножением.
+ */
+inline bool classify_code_points64(const UnicodeCodePoint* code_points, unsigned size, const TwoByteSet& set,
+                                   uint64_t& letters) {
+  return kernels().classify_code_points64(code_points, size, set, letters);
+}
+
+/**
+ * @brief Определяет самый быстрый декодер, корректный для блока
+ *
+ * Engine::Ascii - все байты 0xxxxxxx. Engine::TwoByte - нет ведущих байт 3- и 4-байтовых
+ * последовательностей (>= 0xE0), то есть только ASCII, латиница с диакритикой, греческий,
+ * кириллица и прочие символы U+0080..U+07FF. Иначе Engine::Utf8.
+ *
+ * @note Цикл - редукция максимума, компилятор векторизует его под набор инструкций из kernels()
+ */
+inline Engine classify(const uint8_t* first, const uint8_t* last) {
+  return kernels().classify(first, last);
+}
+
+/**
+ * @brief Копирует 64 ASCII-байта из bytes в out, приводя A-Z к a-z
+ */
+inline void fold_ascii64(const uint8_t* bytes, uint8_t* out) {
+  kernels().fold_ascii64(bytes, out);
+}
+
+/**
+ * @brief Приводит регистр code points [first, last) на месте, как fold_case(uint32_t)
+ *
+ * @note Каждые 16 code points из ASCII и основной кириллицы приводятся арифметикой без таблиц,
+ *       и компилятор векторизует цикл; остальные - по таблице.
+ */
+inline void fold_case(UnicodeCodePoint* first, UnicodeCodePoint* last) {
+  kernels().fold_case(first, last);
+}
+
+/**
+ * @brief Проверяет, что [first, last) - корректный utf-8
+ *
+ * Векторный вариант (Keiser, Lemire) проверяет по 64 байта за шаг без ветвлений на каждый байт:
+ * AVX2 и AVX-512 - 2 x 32 байта, SSE4.2 и NEON - 4 x 16 байт, ASCII-блоки пропускаются целиком.
+ * Точную позицию ошибки находит find_invalid_utf8, начиная с блока, в котором она замечена.
+ * Scalar - сразу find_invalid_utf8.
+ *
+ * @return Начало первой некорректной последовательности (то же, что сообщил бы декодер
+ *         с OnInvalid::Stop) либо last
+ */
+inline const uint8_t* validate_utf8(const uint8_t* first, const uint8_t* last) {
+  return kernels().validate_utf8(first, last);
+}
+
+/// Смещение первой некорректной последовательности input либо input.size()
+inline size_t validate_utf8(std::string_view input) {
+  const auto first = reinterpret_cast<const uint8_t*>(input.data());
+  return static_cast<size_t>(validate_utf8(first, first + input.size()) - first);
+}
+
+/**
+ * @brief transcode_utf8 без проверок для входа, прошедшего validate_utf8
+ *
+ * Длина символа определяется по ведущему байту, продолжения не проверяются. Последний символ
+ * может заканчиваться за block_end: вход должен состоять из целых символов.
+ *
+ * @param out Буфер не меньше (block_end - first) + 16 элементов
+ */
+inline TranscodeResult transcode_valid(const uint8_t* first, const uint8_t* block_end, UnicodeCodePoint* out) {
+  return kernels().transcode_valid(first, block_end, out);
+}
+
+/**
+ * @brief Декодирует блок [first, block_end) декодером E, передавая code points в push
+ *
+ * Последний символ блока может заканчиваться за block_end (но не за last).
+ * Результаты всех декодеров на блоке, для которого classify вернула E, совпадают с Engine::Utf8,
+ * в том числе на некорректном входе: его разбирает decode_utf8_dfa с политикой policy.
+ *
+ * @return Позиция, на которой декодирование остановилось: >= block_end, либо начало
+ *         незавершённой последовательности в конце входа
+ * @throws InvalidUtf8 при OnInvalid::Stop
+ */
+template<Engine E, typename Push>
+__attribute__((always_inline)) inline const uint8_t* decode_block(const uint8_t* first, const uint8_t* block_end,
+                                                                    const uint8_t* last, Push& push,
+                                                                    OnInvalid policy = OnInvalid::Replace) {
+  if constexpr (E == Engine::Ascii) {
+    for (; first != block_end; ++first) {
+      push(static_cast<UnicodeCodePoint>(*first));
+    }
+  } else if constexpr (E == Engine::TwoByte) {
+    while (first < block_end) {
+      if (*first < 0x80) {
+        push(static_cast<UnicodeCodePoint>(*first++));
+        continue;
+      }
+      if (*first >= 0xC2 && last - first >= 2 && (first[1] & 0xC0) == 0x80) [[likely]] {
+        push(static_cast<UnicodeCodePoint>((first[0] & 0x1F) << 6 | (first[1] & 0x3F)));
+        first += 2;
+        continue;
+      }
+      // Одиночный байт продолжения, C0/C1, оборванная последовательность
+      const auto stop = decode_block<Engine::Utf8>(first, first + 1, last, push, policy);
+      if (stop == first) {
+        return first;
+      }
+      first = stop;
+    }
+  } else {
+    // Автомат пишет в буфер без ветвлений, затем буфер передаётся в push
+    constexpr size_t Step = 64;
+    std::array<UnicodeCodePoint, Step + 4> code_points;
+    while (first < block_end) {
+      const auto step_end = first + std::min<size_t>(Step, block_end - first);
+      auto out = code_points.data();
+      const auto stop = decode_utf8_dfa(first, step_end, last, out, policy);
+      for (auto it = code_points.data(); it != out; ++it) {
+        push(*it);
+      }
+      if (stop < step_end) {
+        return stop;
+      }
+      first = stop;
+    }
+  }
+  return first;
+}
+
+/**
+ * @brief Декодирует utf-8, выбирая декодер заново для каждого блока EngineBlockSize байт
+ *
+ * @param stats Если не nullptr, сюда добавляется объём, обработанный каждым декодером
+ * @return Начало незавершённой последовательности в конце входа либо last
+ */
+template<typename Push>
+const uint8_t* decode_utf8_adaptive(const uint8_t* first, const uint8_t* last, Push&& push,
+                                    EngineStats* stats = nullptr, OnInvalid policy = OnInvalid::Replace) {
+  while (first < last) {
+    const auto block_end = first + std::min<size_t>(EngineBlockSize, last - first);
+    const auto engine = classify(first, block_end);
+    const uint8_t* stop = nullptr;
+    switch (engine) {
+      case Engine::Ascii: stop = decode_block<Engine::Ascii>(first, block_end, last, push, policy); break;
+      case Engine::TwoByte: stop = decode_block<Engine::TwoByte>(first, block_end, last, push, policy); break;
+      // classify не возвращает CodePage (это разбор однобайтовых кодировок), но и тогда блок разбирается полным декодером
+      case Engine::CodePage:
+      case Engine::Utf8: stop = decode_block<Engine::Utf8>(first, block_end, last, push, policy); break;
+    }
+    if (stats != nullptr) {
+      stats->add(engine, stop - first);
+    }
+    if (stop < block_end) {
+      return stop;
+    }
+    first = stop;
+  }
+  return first;
+}
+
+namespace detail {
+
+/**
+ * Таблица упаковки для pshufb: для маски mask из 8 бит (какие 16-битные элементы оставить)
+ * перестановка байт, сдвигающая оставленные элементы в начало вектора
+ */
+constexpr std::array<std::array<uint8_t, 16>, 256> make_pack_table() {
+  std::array<std::array<uint8_t, 16>, 256> table{};
+  for (unsigned mask = 0; mask < 256; ++mask) {
+    unsigned out = 0;
+    for (unsigned lane = 0; lane < 8; ++lane) {
+      if (mask & (1u << lane)) {
+        table[mask][out++] = static_cast<uint8_t>(2 * lane);
+        table[mask][out++] = static_cast<uint8_t>(2 * lane + 1);
+      }
+    }
+    for (; out < 16; ++out) {
+      table[mask][out] = 0x80;  // pshufb обнуляет байт
+    }
+  }
+  return table;
+}
+
+alignas(16) inline constexpr auto PackTable = make_pack_table();
+
+} // namespace detail
+
+/**
+ * @brief Векторное преобразование utf-8 в utf-32
+ *
+ * Вход идёт по 16 байт:
+ * - только ASCII: байты расширяются до 32 бит (AVX-512 - сразу по 64 байта);
+ * - только корректные 1- и 2-байтовые символы (латиница, кириллица):
+ *   значения всех позиций считаются одновременно в 16-битных элементах, затем позиции начала
+ *   символов упаковываются перестановкой по таблице detail::PackTable (pshufb);
+ * - иначе 16 байт декодируются автоматом decode_utf8_dfa, он же разбирает некорректный вход по policy.
+ * Вариант NEON векторизует только ASCII, scalar декодирует весь блок автоматом.
+ * Результат совпадает со скалярным декодером и на некорректном входе.
+ * Как и в decode_block, последний символ блока может заканчиваться за block_end (но не за last).
+ *
+ * @param out Буфер не меньше (block_end - first) + 16 элементов: векторные записи выходят за последний символ
+ * @return Позиция остановки (>= block_end, либо начало незавершённой последовательности в конце входа)
+ *         и конец записанных code points
+ * @throws InvalidUtf8 при OnInvalid::Stop
+ */
+inline TranscodeResult transcode_utf8(const uint8_t* first, const uint8_t* block_end, const uint8_t* last,
+                                      UnicodeCodePoint* out, OnInvalid policy = OnInvalid::Replace) {
+  return kernels().transcode_utf8(first, block_end, last, out, policy);
+}
+
+/**
+ * @brief transcode_utf8 для блока, который classify отнесла к Engine::TwoByte
+ *
+ * Без байт >= 0xE0 не нужна проверка на 3- и 4-байтовые символы: SSE4.2 и выше разбирают по 16 байт
+ * упаковкой 2-байтовых значений, как transcode_utf8, а последние байты блока - тоже вектором, читающим
+ * за block_end, а не автоматом. NEON и scalar - автомат, как в transcode_utf8. Некорректный вход
+ * разбирает decode_utf8_dfa с policy, поэтому на таком блоке результат совпадает с transcode_utf8.
+ *
+ * @param out Буфер не меньше (block_end - first) + 16 элементов
+ * @throws InvalidUtf8 при OnInvalid::Stop
+ */
+inline TranscodeResult transcode_two_byte(const uint8_t* first, const uint8_t* block_end, const uint8_t* last,
+                                          UnicodeCodePoint* out, OnInvalid policy = OnInvalid::Replace) {
+  return kernels().transcode_two_byte(first, block_end, last, out, policy);
+}
+
+/**
+ * @brief Преобразует весь вход в code points
+ *
+ * Незавершённая последовательность в конце входа считается некорректной.
+ *
+ * @throws InvalidUtf8 со смещением от начала input при OnInvalid::Stop
+ */
+inline std::vector<UnicodeCodePoint> transcode_utf8(std::string_view input, OnInvalid policy = OnInvalid::Replace) {
+  std::vector<UnicodeCodePoint> code_points(input.size() + 16);
+  auto first = reinterpret_cast<const uint8_t*>(input.data());
+  const auto last = first + input.size();
+  try {
+    auto [stop, out] = transcode_utf8(first, last, last, code_points.data(), policy);
+    if (stop != last) {
+      if (policy == OnInvalid::Stop) {
+        throw InvalidUtf8(stop);
+      }
+      *out = ReplacementCharacter;
+      out += policy == OnInvalid::Replace;
+    }
+    code_points.resize(out - code_points.data());
+  } catch (const InvalidUtf8& e) {
+    throw e.at(first);
+  }
+  return code_points;
+}
+
+/**
+ * @brief Раскладывает по группам size <= 64 символов по маске letters
+ *
+ * Слова выделяются по переходам в маске символов группы (countr_one / countr_zero)
+ * и добавляются в группу целиком, без ветвлений на каждый символ.
+ */
+template<typename Char, typename Group>
+__attribute__((always_inline)) inline void group_runs(const Char* chars, unsigned size, uint64_t letters, Group& group) {
+  for (unsigned pos = 0; pos < size;) {
+    const auto rest = letters >> pos;
+    if (rest & 1) {
+      const auto run = static_cast<unsigned>(std::countr_one(rest));
+      group.append(chars + pos, run);
+      pos += run;
+    } else {
+      group.close();
+      pos += rest == 0 ? size - pos : static_cast<unsigned>(std::countr_zero(rest));
+    }
+  }
+}
+
+/**
+ * @brief Раскладывает по группам 64 ASCII-байта
+ */
+template<typename Group>
+__attribute__((always_inline)) inline void group_ascii64(const Kernels& kernel, const uint8_t* bytes, uint64_t letters,
+                                                         Group& group, bool fold) {
+  constexpr unsigned Window = 64;
+  std::array<uint8_t, Window> folded;
+  if (fold && letters != 0) {
+    kernel.fold_ascii64(bytes, folded.data());
+    bytes = folded.data();
+  }
+  group_runs(bytes, Window, letters, group);
+}
+
+/**
+ * @brief Раскладывает по группам декодированные code points [first, last)
+ *
+ * Кусок до 64 code points из символов до U+0800 (ASCII и 2-байтовые) classify_code_points64
+ * переводит в маску символов группы, и group_runs выделяет слова по переходам в ней.
+ * В куске с символами от U+0800 (и U+FFFD) подряд идущие символы группы до U+0800 добавляются
+ * целиком, подряд идущие разделители закрывают группу один раз, а остальные уходят через push.
+ *
+ * @note Не встраивается: встроенная в tokenize вторая копия group_runs при -O3 замедляла разбор
+ *       input.txt в полтора раза, вызов на окно из 64 байт не заметен.
+ */
+template<typename Group>
+__attribute__((noinline)) void group_code_points(const Kernels& kernel, const UnicodeCodePoint* first,
+                                                 const UnicodeCodePoint* last, const TwoByteSet& letters,
+                                                 Group& group) {
+  constexpr size_t Window = 64;
+  while (first != last) {
+    const auto size = static_cast<unsigned>(std::min<size_t>(Window, last - first));
+    const auto chunk_end = first + size;
+    uint64_t mask = 0;
+    if (kernel.classify_code_points64(first, size, letters, mask)) [[likely]] {
+      group_runs(first, size, mask, group);
+      first = chunk_end;
+      continue;
+    }
+    while (first != chunk_end) {
+      if (*first >= TwoByteSet::Limit) {
+        group.push(*first++);
+        continue;
+      }
+      const bool letter = letters.contains(*first);
+      auto run = first + 1;
+      while (run != chunk_end && *run < TwoByteSet::Limit && letters.contains(*run) == letter) {
+        ++run;
+      }
+      if (letter) {
+        group.append(first, static_cast<size_t>(run - first));
+      } else {
+        group.close();
+      }
+      first = run;
+    }
+  }
+}
+
+/**
+ * @brief Ядро токенизатора: декодирует utf-8 и раскладывает code points по группам
+ *
+ * Вход идёт окнами по 64 байта:
+ * - окно из одних ASCII (Engine::Ascii) обрабатывается векторно: classify_ascii64 строит маску
+ *   символов группы, по которой group_ascii64 выделяет слова;
+ * - остальные окна декодер преобразует в code points по классу блока EngineBlockSize байт, в котором
+ *   лежит окно (classify, как в decode_utf8_adaptive): Engine::TwoByte - transcode_two_byte,
+ *   Engine::Utf8 - transcode_utf8, а для проверенного входа transcode_valid.
+ * Буфер code points раскладывается по группам group_code_points. Хвост короче окна -
+ * decode_utf8_adaptive. В stats попадает декодер, который на самом деле разобрал каждое окно.
+ * При fold регистр приводится здесь же, над окном или буфером, пока они в кеше.
+ *
+ * @tparam Validated Вход прошёл validate_utf8 и состоит из целых символов: вместо transcode_utf8
+ *                   работает transcode_valid без проверок
+ * @tparam Group Приёмник с методами:
+ *               append(const uint8_t* first, size_t n) - n ASCII-символов группы подряд;
+ *               append(const UnicodeCodePoint* first, size_t n) - n code points группы подряд;
+ *               push(UnicodeCodePoint) - очередной code point, предикат ещё не применён;
+ *               close() - встречен разделитель (вызывается и при пустой группе)
+ * @param ascii Символы группы среди ASCII: AsciiSet::from(pred), а при fold - по pred(fold_case(c))
+ * @param two_byte Символы группы до U+0800: TwoByteSet::from(pred), классифицируются уже приведённые code points
+ * @param stats Если не nullptr, сюда добавляется объём, обработанный каждым декодером
+ * @param policy Что делать с некорректными последовательностями
+ * @param fold Приводить регистр (fold_case) до передачи в группу
+ * @return Начало незавершённой последовательности в конце входа либо last
+ * @throws InvalidUtf8 при OnInvalid::Stop
+ */
+template<bool Validated = false, typename Group>
+const uint8_t* tokenize(const uint8_t* first, const uint8_t* last, const AsciiSet& ascii, const TwoByteSet& two_byte,
+                        Group& group, EngineStats* stats = nullptr, OnInvalid policy = OnInvalid::Replace,
+                        bool fold = false) {
+  constexpr size_t Window = 64;
+  std::array<UnicodeCodePoint, Window + 16> code_points;
+  auto push = [&group, fold](UnicodeCodePoint code_point) { group.push(fold ? fold_case(code_point) : code_point); };
+  const auto& kernel = kernels();
+  const uint8_t* block_end = first;
+  Engine engine = Engine::Utf8;
+
+  while (static_cast<size_t>(last - first) >= Window) {
+    uint64_t letters = 0;
+    if (kernel.classify_ascii64(first, ascii, letters)) {
+      group_ascii64(kernel, first, letters, group, fold);
+      if (stats != nullptr) {
+        stats->add(Engine::Ascii, Window);
+      }
+      first += Window;
+      continue;
+    }
+
+    // В окне есть многобайтовые символы: векторное преобразование в code points до конца окна
+    // декодером, выбранным для блока. Окно целиком лежит в блоке, для которого выбран декодер
+    const auto window_end = first + Window;
+    if (window_end > block_end) {
+      block_end = first + std::min<size_t>(EngineBlockSize, last - first);
+      engine = kernel.classify(first, block_end);
+    }
+    const auto [stop, end] =
+        engine == Engine::TwoByte ? kernel.transcode_two_byte(first, window_end, last, code_points.data(), policy)
+        : Validated               ? kernel.transcode_valid(first, window_end, code_points.data())
+                                  : kernel.transcode_utf8(first, window_end, last, code_points.data(), policy);
+    if (fold) {
+      kernel.fold_case(code_points.data(), end);
+    }
+    group_code_points(kernel, code_points.data(), end, two_byte, group);
+    if (stats != nullptr) {
+      stats->add(engine, stop - first);
+    }
+    if (stop < window_end) {
+      return stop;
+    }
+    first = stop;
+  }
+  return decode_utf8_adaptive(first, last, push, stats, policy);
+}
+
+/**
+ * @brief Токенизатор однобайтовой кодировки: каждый байт - code point из таблицы page
+ *
+ * ASCII-окна разбираются так же, как в tokenize. Остальные байты переводятся в code points
+ * одной подстановкой на байт, без разбора последовательностей. Некорректных и незавершённых
+ * символов не бывает, поэтому вход обрабатывается целиком.
+ *
+ * @param ascii, two_byte Символы группы, как в tokenize
+ */
+template<typename Group>
+void tokenize_code_page(const uint8_t* first, const uint8_t* last, const CodePage& page, const AsciiSet& ascii,
+                        const TwoByteSet& two_byte, Group& group, EngineStats* stats = nullptr, bool fold = false) {
+  constexpr size_t Window = 64;
+  std::array<UnicodeCodePoint, Window> code_points;
+  const auto& kernel = kernels();
+
+  while (first != last) {
+    const auto size = std::min<size_t>(Window, last - first);
+    uint64_t letters = 0;
+    if (size == Window && kernel.classify_ascii64(first, ascii, letters)) {
+      group_ascii64(kernel, first, letters, group, fold);
+      if (stats != nullptr) {
+        stats->add(Engine::Ascii, Window);
+      }
+      first += Window;
+      continue;
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+      code_points[i] = page[first[i]];
+    }
+    if (fold) {
+      kernel.fold_case(code_points.data(), code_points.data() + size);
+    }
+    group_code_points(kernel, code_points.data(), code_points.data() + size, two_byte, group);
+    if (stats != nullptr) {
+      stats->add(Engine::CodePage, size);
+    }
+    first += size;
+  }
+}
+
+/**
+ * @brief Объём начала входа (не больше limit байт), который разберёт каждый декодер tokenize
+ *
+ * Начало входа проходит через tokenize с приёмником, который ничего не сохраняет, так что декодеры
+ * выбираются ровно так же, как при подсчёте. Некорректные последовательности заменяются.
+ */
+inline EngineStats prescan(std::string_view input, size_t limit = 4 << 20) {
+  struct {
+    void append(const uint8_t*, size_t) {}
+    void append(const UnicodeCodePoint*, size_t) {}
+    void push(UnicodeCodePoint) {}
+    void close() {}
+  } sink;
+  EngineStats stats;
+  const auto first = reinterpret_cast<const uint8_t*>(input.data());
+  tokenize(first, first + std::min(input.size(), limit), AsciiSet{}, TwoByteSet{}, sink, &stats);
+  return stats;
+}
+
+namespace detail {
+
+// Весь вход [bytes, end) через подходящий токенизатор: векторный путь для ASCII, специализированные
+// декодеры для остального. Оборванная последовательность в конце обрабатывается по policy,
+// смещение в InvalidUtf8 - от начала входа. Последнюю группу закрывает вызывающий
+template<typename Pred, typename Group>
+void tokenize_input(const uint8_t* bytes, const uint8_t* end, Pred& pred, Group& group, OnInvalid policy,
+                    bool fold, bool validated, Encoding encoding) {
+  const auto ascii = fold ? AsciiSet::from([&pred](UnicodeCodePoint c) { return pred(fold_case(c)); })
+                          : AsciiSet::from(pred);
+  const auto two_byte = TwoByteSet::from(pred);
+  if (const auto page = code_page(encoding)) {
+    tokenize_code_page(bytes, end, *page, ascii, two_byte, group, nullptr, fold);
+    return;
+  }
+  try {
+    const auto stop = validated ? tokenize<true>(bytes, end, ascii, two_byte, group, nullptr, policy, fold)
+                                : tokenize(bytes, end, ascii, two_byte, group, nullptr, policy, fold);
+    if (stop != end) {
+      // Оборванная последовательность в конце входа
+      if (policy == OnInvalid::Stop) {
+        throw InvalidUtf8(stop);
+      }
+      if (policy == OnInvalid::Replace) {
+        group.push(ReplacementCharacter);
+      }
+    }
+  } catch (const InvalidUtf8& e) {
+    throw e.at(bytes);
+  }
+}
+
+} // namespace detail
+
 /**
  * @brief Groups UTF-8 encoded characters based on a predicate and converts groups using a converter
  *
@@ -98,6 +914,10 @@ using UnicodeCodePoint = uint32_t;
  * @param[out] result Output iterator where converted groups will be stored
  * @param[in] pred Predicate determining group inclusion (returns true if code point belongs to current group)
  * @param[in] convert Converter function that transforms code point groups to output type
+ * @param[in] policy What to do with invalid or truncated UTF-8 sequences
+ * @param[in] fold Fold case (fold_case) before the predicate is applied, so groups hold folded code points
+ * @param[in] validated The input has passed validate_utf8, so it is decoded without checks and policy is unused
+ * @param[in] encoding Input encoding; single-byte ones are mapped byte by byte (tokenize_code_page)
  *
  * @pre InputIterator must dereference to byte-like type (char, uint8_t, etc.)
  * @pre GroupInclusionPredicate must satisfy std::predicate<UnicodeCodePoint> concept
@@ -107,7 +927,7 @@ using UnicodeCodePoint = uint32_t;
  * @note Empty groups are not output
  * @note Any trailing group will be output even without a terminating non-matching character
  *
- * @throws None (no-throw guarantee if converter and predicate don't throw)
+ * @throws InvalidUtf8 with the byte offset of the first invalid sequence if policy is OnInvalid::Stop
  *
  * Example usage:
  * @code
@@ -120,7 +940,10 @@ using UnicodeCodePoint = uint32_t;
  * @endcode
  */
 template<typename InputIterator, typename OutputIterator, typename GroupInclusionPredicate, typename Converter>
-void group_if(InputIterator first, InputIterator last, OutputIterator result, GroupInclusionPredicate pred, Converter convert) {
+  requires std::contiguous_iterator<InputIterator> && (sizeof(std::iter_value_t<InputIterator>) == 1)
+void group_if(InputIterator first, InputIterator last, OutputIterator result, GroupInclusionPredicate pred, Converter convert,
+              OnInvalid policy = OnInvalid::Replace, bool fold = false, bool validated = false,
+              Encoding encoding = Encoding::Utf8) {
   using CodePointGroup = std::vector<UnicodeCodePoint>;
   /*
   static_assert(requires (Converter conv, CodePointGroup group, GroupInclusionPredicate pred, UnicodeCodePoint point)
@@ -134,64 +957,381 @@ void group_if(InputIterator first, InputIterator last, OutputIterator result, Gr
 
   CodePointGroup char_group;
   char_group.reserve(32);
-  for (; first != last; ++first) {
-    const auto char_length = get_utf8_char_len(*first);
-    auto code_point = static_cast<UnicodeCodePoint>(*first);
-#define USE_SWITCH
-#ifdef USE_SWITCH
-    switch (char_length) {
-      [[likely]] case 1: {
-        break;
-      }
-      [[likely]] case 2: {
-        auto a = *first++;
-        auto b = *first;
-        code_point = (a & 0x1F) << 6 | (b & 0x3F);
-        break;
-      }
-      case 3: {
-        auto a = *first++;
-        auto b = *first++;
-        auto c = *first;
-        code_point = (a& 0x1F) << 12 | (b & 0x3F) << 6 | (c& 0x3F);
-        break;
-      }
-      case 4: {
-        auto a = *first++;
-        auto b = *first++;
-        auto c = *first++;
-        auto d = *first;
-        code_point = (a & 0x1F) << 18 | (b & 0x3F) << 12 | (c & 0x3F) << 6 | (d & 0x3F);
-        break;
-      }
-      default: {}
-    }
-#else
-    if (code_point == 2) {
-        auto a = *first++;
-        auto b = *first;
-        code_point = (a & 0x1F) << 6 | (b & 0x3F);
-    } else if (code_point == 3) {
-        auto a = *first++;
-        auto b = *first++;
-        auto c = *first;
-        code_point = (a& 0x1F) << 12 | (b & 0x3F) << 6 | (c& 0x3F);
-    } else if (code_point == 4) {
-        auto a = *first++;
-        auto b = *first++;
-        auto c = *first++;
-        auto d = *first;
-        code_point = (a & 0x1F) << 18 | (b & 0x3F) << 12 | (c & 0x3F) << 6 | (d & 0x3F);
-    }
-#endif
-    if (pred(code_point)) {
-      char_group.push_back(code_point);
-    } else {
+  auto emit = [&] {
+    if (not char_group.empty()) {
       CodePointGroup empty_char_group; empty_char_group.reserve(32);
       *result = convert(std::exchange(char_group, std::move(empty_char_group)));
       ++result;
     }
+  };
+  auto group = [&](UnicodeCodePoint code_point) {
+    if (pred(code_point)) {
+      char_group.push_back(code_point);
+    } else {
+      emit();
+    }
+  };
+
+  struct {
+    decltype(group)& push;
+    decltype(emit)& close;
+    CodePointGroup& char_group;
+
+    void append(const uint8_t* letters, size_t n) { char_group.insert(char_group.end(), letters, letters + n); }
+    void append(const UnicodeCodePoint* letters, size_t n) { char_group.insert(char_group.end(), letters, letters + n); }
+  } sink{group, emit, char_group};
+
+  const auto bytes = reinterpret_cast<const uint8_t*>(std::to_address(first));
+  detail::tokenize_input(bytes, bytes + (last - first), pred, sink, policy, fold, validated, encoding);
+  emit();
+}
+
+/// group_if для несмежного входа: байты сначала копируются в непрерывный буфер
+template<typename InputIterator, typename OutputIterator, typename GroupInclusionPredicate, typename Converter>
+void group_if(InputIterator first, InputIterator last, OutputIterator result, GroupInclusionPredicate pred, Converter convert,
+              OnInvalid policy = OnInvalid::Replace, bool fold = false, bool validated = false,
+              Encoding encoding = Encoding::Utf8) {
+  const std::vector<uint8_t> bytes(first, last);
+  group_if(bytes.begin(), bytes.end(), result, std::move(pred), std::move(convert), policy, fold, validated, encoding);
+}
+
+/// Группа code points в общем буфере: смещение и длина
+struct WordSpan {
+  size_t offset = 0;
+  size_t size = 0;
+
+  /// Code points группы в буфере arena
+  [[nodiscard]] std::span<const UnicodeCodePoint> of(std::span<const UnicodeCodePoint> arena) const noexcept {
+    return arena.subspan(offset, size);
+  }
+
+  bool operator==(const WordSpan&) const = default;
+};
+
+/**
+ * @brief group_if без выделения памяти на каждую группу
+ *
+ * Code points всех групп дописываются подряд в один буфер arena, а в result выводится WordSpan
+ * каждой группы - её смещение и длина в arena. Пустые группы не создаются вовсе. Пока буфера
+ * хватает, разбор не обращается к аллокатору: utf-8 и однобайтовые кодировки дают не больше
+ * code points, чем байт, поэтому arena.reserve(arena.size() + (last - first) + 1) исключает
+ * перевыделения полностью (+1 - U+FFFD на оборванный хвост).
+ *
+ * @param[in,out] arena Буфер code points; группы дописываются в конец, прежнее содержимое сохраняется
+ * @param[out] result Output iterator для WordSpan; смещения - от начала arena
+ *
+ * Остальные параметры и исключения - как у group_if.
+ */
+template<typename InputIterator, typename OutputIterator, typename GroupInclusionPredicate>
+  requires std::contiguous_iterator<InputIterator> && (sizeof(std::iter_value_t<InputIterator>) == 1)
+void group_spans(InputIterator first, InputIterator last, std::vector<UnicodeCodePoint>& arena, OutputIterator result,
+                 GroupInclusionPredicate pred, OnInvalid policy = OnInvalid::Replace, bool fold = false,
+                 bool validated = false, Encoding encoding = Encoding::Utf8) {
+  struct {
+    std::vector<UnicodeCodePoint>& arena;
+    OutputIterator& result;
+    GroupInclusionPredicate& pred;
+    size_t start;
+
+    void push(UnicodeCodePoint code_point) {
+      if (pred(code_point)) {
+        arena.push_back(code_point);
+      } else {
+        close();
+      }
+    }
+    void close() {
+      if (arena.size() != start) {
+        *result = WordSpan{start, arena.size() - start};
+        ++result;
+        start = arena.size();
+      }
+    }
+    void append(const uint8_t* letters, size_t n) { arena.insert(arena.end(), letters, letters + n); }
+    void append(const UnicodeCodePoint* letters, size_t n) { arena.insert(arena.end(), letters, letters + n); }
+  } sink{arena, result, pred, arena.size()};
+
+  const auto bytes = reinterpret_cast<const uint8_t*>(std::to_address(first));
+  detail::tokenize_input(bytes, bytes + (last - first), pred, sink, policy, fold, validated, encoding);
+  sink.close();
+}
+
+/**
+ * @brief group_if без списка групп: каждая готовая группа сразу передаётся visit
+ *
+ * Группа собирается в одном буфере, который переиспользуется от группы к группе, так что после
+ * первых слов разбор не выделяет память, а текст ни в какой момент не существует как список слов.
+ *
+ * @param[in] visit Callable, принимающий std::span<const UnicodeCodePoint> - непустую группу;
+ *                  span действителен только до возврата из visit
+ *
+ * Остальные параметры и исключения - как у group_if.
+ */
+template<typename InputIterator, typename GroupInclusionPredicate, typename Visitor>
+  requires std::contiguous_iterator<InputIterator> && (sizeof(std::iter_value_t<InputIterator>) == 1)
+void for_each_group(InputIterator first, InputIterator last, GroupInclusionPredicate pred, Visitor visit,
+                    OnInvalid policy = OnInvalid::Replace, bool fold = false, bool validated = false,
+                    Encoding encoding = Encoding::Utf8) {
+  struct {
+    GroupInclusionPredicate& pred;
+    Visitor& visit;
+    std::vector<UnicodeCodePoint> char_group;
+
+    void push(UnicodeCodePoint code_point) {
+      if (pred(code_point)) {
+        char_group.push_back(code_point);
+      } else {
+        close();
+      }
+    }
+    void close() {
+      if (not char_group.empty()) {
+        visit(std::span<const UnicodeCodePoint>(char_group));
+        char_group.clear();
+      }
+    }
+    void append(const uint8_t* letters, size_t n) { char_group.insert(char_group.end(), letters, letters + n); }
+    void append(const UnicodeCodePoint* letters, size_t n) { char_group.insert(char_group.end(), letters, letters + n); }
+  } sink{pred, visit, {}};
+  sink.char_group.reserve(64);
+
+  const auto bytes = reinterpret_cast<const uint8_t*>(std::to_address(first));
+  detail::tokenize_input(bytes, bytes + (last - first), pred, sink, policy, fold, validated, encoding);
+  sink.close();
+}
+
+/**
+ * @brief Находит ближайшую к pos границу групп, не разрезающую ни символ, ни группу
+ *
+ * Пропускает байты продолжения utf-8 до начала следующего символа, затем идёт вперёд
+ * до первого code point, не удовлетворяющего предикату. Вход, разрезанный в найденной
+ * позиции, группируется так же, как целый.
+ *
+ * @param policy Политика, с которой будет декодироваться вход: при OnInvalid::Skip некорректные
+ *               последовательности не разделяют группы. OnInvalid::Stop здесь не бросает исключение:
+ *               некорректная последовательность становится границей, и ошибку найдёт декодер
+ * @param fold Будет ли декодер приводить регистр: предикат тогда применяется к fold_case(code point)
+ * @param encoding Кодировка входа: в однобайтовой граница может быть на любом байте
+ * @return Смещение первого байта символа-разделителя либо input.size()
+ */
+template<typename GroupInclusionPredicate>
+size_t next_group_boundary(std::string_view input, size_t pos, GroupInclusionPredicate pred,
+                           OnInvalid policy = OnInvalid::Replace, bool fold = false,
+                           Encoding encoding = Encoding::Utf8) {
+  const auto bytes = reinterpret_cast<const uint8_t*>(input.data());
+  const auto size = input.size();
+  if (const auto page = code_page(encoding)) {
+    while (pos < size && pred(fold ? fold_case((*page)[bytes[pos]]) : (*page)[bytes[pos]])) {
+      ++pos;
+    }
+    return pos;
   }
+  if (policy == OnInvalid::Stop) {
+    policy = OnInvalid::Replace;
+  }
+
+  while (pos < size && (bytes[pos] & 0xC0) == 0x80) { ++pos; }  // 10xxxxxx
+
+  std::array<UnicodeCodePoint, 8> code_points;
+  while (pos < size) {
+    auto out = code_points.data();
+    const auto next = decode_utf8_dfa(bytes + pos, bytes + pos + 1, bytes + size, out, policy);
+    if (next == bytes + pos) {
+      return size;  // оборванная последовательность в конце входа
+    }
+    if (out != code_points.data() && not pred(fold ? fold_case(code_points[0]) : code_points[0])) {
+      return pos;
+    }
+    pos = next - bytes;
+  }
+  return size;
 }
 
-} // namespace uu
\ No newline at end of file
+/**
+ * @brief Потоковый вариант group_if: принимает вход блоками произвольного размера
+ *
+ * Блоки могут разрезать как многобайтовую последовательность utf-8, так и группу (слово):
+ * незавершённая последовательность (до 3 байт) и незавершённая группа переносятся
+ * в следующий вызов feed(). Поэтому память ограничена размером блока и длиной самой длинной группы.
+ *
+ * Каждая завершённая непустая группа передаётся в sink как std::span<const UnicodeCodePoint>,
+ * который действителен только на время вызова.
+ *
+ * Некорректные последовательности разбираются по политике policy; исключение InvalidUtf8
+ * при OnInvalid::Stop содержит смещение от начала всего потока. После set_fold_case(true)
+ * регистр приводится при декодировании, и предикат видит уже приведённые code points.
+ *
+ * @tparam GroupInclusionPredicate Callable type that takes UnicodeCodePoint and returns bool
+ * @tparam GroupSink Callable type that accepts std::span<const UnicodeCodePoint>
+ *
+ * Example usage:
+ * @code
+ * GroupStream stream(is_letter, [&](auto group) { count(group); });
+ * for (auto chunk = reader.next(); not empty(chunk); chunk = reader.next()) {
+ *   stream.feed(chunk);
+ * }
+ * stream.finish();
+ * @endcode
+ */
+template<typename GroupInclusionPredicate, typename GroupSink>
+class GroupStream final {
+public:
+  GroupStream(GroupInclusionPredicate pred, GroupSink sink, OnInvalid policy = OnInvalid::Replace)
+      : pred_(std::move(pred)), sink_(std::move(sink)), ascii_(AsciiSet::from(pred_)),
+        two_byte_(TwoByteSet::from(pred_)), policy_(policy) {
+    group_.reserve(32);
+  }
+
+  void feed(std::string_view chunk) {
+    const auto begin = reinterpret_cast<const uint8_t*>(chunk.data());
+    const auto last = begin + chunk.size();
+    auto first = begin;
+
+    // Дочитываем последовательность, разрезанную границей предыдущего блока
+    try {
+      while (pending_size_ != 0 && first != last) {
+        pending_[pending_size_++] = *first++;
+        drain_pending();
+      }
+    } catch (const InvalidUtf8& e) {
+      throw e.at(pending_.data(), pending_offset_);
+    }
+
+    if (pending_size_ == 0) {
+      struct Sink {
+        GroupStream& self;
+
+        void append(const uint8_t* letters, size_t n) { self.group_.insert(self.group_.end(), letters, letters + n); }
+        void append(const UnicodeCodePoint* letters, size_t n) { self.group_.insert(self.group_.end(), letters, letters + n); }
+        void push(UnicodeCodePoint code_point) { self.push(code_point); }
+        void close() { self.flush(); }
+      } sink{*this};
+      if (page_ != nullptr) {
+        tokenize_code_page(first, last, *page_, ascii_, two_byte_, sink, &stats_, fold_);
+        offset_ += chunk.size();
+        return;
+      }
+      try {
+        first = validated_ ? tokenize<true>(first, last, ascii_, two_byte_, sink, &stats_, policy_, fold_)
+                           : tokenize(first, last, ascii_, two_byte_, sink, &stats_, policy_, fold_);
+      } catch (const InvalidUtf8& e) {
+        throw e.at(begin, offset_);
+      }
+      pending_size_ = static_cast<short>(last - first);
+      pending_offset_ = offset_ + (first - begin);
+      std::copy(first, last, pending_.begin());
+    }
+    // иначе весь блок ушёл на продолжение незавершённой последовательности
+    offset_ += chunk.size();
+  }
+
+  /// Объём входа, обработанный каждым декодером
+  [[nodiscard]] const EngineStats& engine_stats() const noexcept { return stats_; }
+
+  /// Политика для последующих блоков
+  void set_policy(OnInvalid policy) noexcept { policy_ = policy; }
+
+  /**
+   * @brief Последующие блоки прошли validate_utf8 и каждый состоит из целых символов
+   *
+   * Такие блоки декодируются без проверок (см. tokenize).
+   */
+  void set_validated(bool validated) noexcept { validated_ = validated; }
+
+  /// Кодировка последующих блоков; однобайтовые не переносят байты между блоками
+  void set_encoding(Encoding encoding) noexcept { page_ = code_page(encoding); }
+
+  /// Приводить ли регистр в последующих блоках
+  void set_fold_case(bool fold) {
+    if (fold != fold_) {
+      fold_ = fold;
+      ascii_ = fold ? AsciiSet::from([this](UnicodeCodePoint c) { return pred_(fold_case(c)); }) : AsciiSet::from(pred_);
+    }
+  }
+
+  /**
+   * @brief Отбрасывает незавершённую группу и перенесённые байты; смещения снова считаются с нуля
+   *
+   * Нужен для повторного использования потока после исключения из feed() или finish():
+   * иначе недописанное слово и смещение достались бы следующему входу.
+   */
+  void reset() noexcept {
+    group_.clear();
+    pending_size_ = 0;
+    pending_offset_ = 0;
+    offset_ = 0;
+  }
+
+  /**
+   * @brief Завершает поток: отдаёт последнюю группу
+   *
+   * Оборванная последовательность в конце входа некорректна и разбирается по политике.
+   * После finish() поток можно использовать заново, смещения снова считаются с нуля.
+   */
+  void finish() {
+    const auto truncated = pending_size_ != 0;
+    const auto offset = pending_offset_;
+    pending_size_ = 0;
+    offset_ = 0;
+    if (truncated && policy_ == OnInvalid::Stop) {
+      group_.clear();
+      throw InvalidUtf8(nullptr, offset);
+    }
+    if (truncated && policy_ == OnInvalid::Replace) {
+      push(ReplacementCharacter);
+    }
+    flush();
+  }
+
+private:
+  __attribute__((always_inline)) void push(UnicodeCodePoint code_point) {
+    if (pred_(code_point)) {
+      group_.push_back(code_point);
+    } else {
+      flush();
+    }
+  }
+
+  // Декодирует из pending_ все завершённые (или отвергнутые) последовательности
+  void drain_pending() {
+    std::array<UnicodeCodePoint, 8> code_points;
+    while (pending_size_ != 0) {
+      auto out = code_points.data();
+      const auto stop = decode_utf8_dfa(pending_.data(), pending_.data() + 1, pending_.data() + pending_size_, out, policy_);
+      for (auto it = code_points.data(); it != out; ++it) {
+        push(fold_ ? fold_case(*it) : *it);
+      }
+      const auto consumed = static_cast<short>(stop - pending_.data());
+      if (consumed == 0) {
+        return;
+      }
+      std::copy(pending_.begin() + consumed, pending_.begin() + pending_size_, pending_.begin());
+      pending_size_ -= consumed;
+      pending_offset_ += consumed;
+    }
+  }
+
+  void flush() {
+    if (not group_.empty()) {
+      sink_(std::span<const UnicodeCodePoint>(group_));
+      group_.clear();
+    }
+  }
+
+  GroupInclusionPredicate pred_;
+  GroupSink sink_;
+  AsciiSet ascii_;
+  TwoByteSet two_byte_;
+  std::vector<UnicodeCodePoint> group_;
+  OnInvalid policy_;
+  bool fold_ = false;
+  bool validated_ = false;
+  const CodePage* page_ = nullptr;  // nullptr - utf-8
+  std::array<uint8_t, 4> pending_{};
+  short pending_size_ = 0;
+  size_t pending_offset_ = 0;  // смещение pending_[0] от начала потока
+  size_t offset_ = 0;          // смещение начала текущего блока
+  EngineStats stats_;
+};
+
+} // namespace uu
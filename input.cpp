@@ -0,0 +1,479 @@
+#include "input.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IO_HAS_MMAP
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define IO_HAS_URING
+#endif
+
+namespace {
+
+// Выравнивание буферов, смещений и длин чтения: достаточно и для O_DIRECT
+constexpr size_t BlockAlignment = 4096;
+
+constexpr size_t align_up(size_t size) {
+  return (size + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+}
+
+#ifdef IO_HAS_MMAP
+// Закрывает дескриптор при выходе из области видимости
+struct FileDescriptor {
+  int fd = -1;
+  ~FileDescriptor() {
+    if (fd >= 0) { ::close(fd); }
+  }
+};
+
+// Читает buffer.size() байт свежеоткрытого файла начиная с position
+void read_all(int fd, std::string& buffer, const std::filesystem::path& path, size_t position) {
+  size_t offset = 0;
+  while (offset < buffer.size()) {
+    // С начала файла - обычный read: он работает и для каналов, где pread недоступен
+    auto n = position == 0 ? ::read(fd, buffer.data() + offset, buffer.size() - offset)
+                           : ::pread(fd, buffer.data() + offset, buffer.size() - offset, static_cast<off_t>(position + offset));
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      throw std::runtime_error("Failed to read file: " + path.string());
+    }
+    if (n == 0) { break; }  // файл укоротили во время чтения
+    offset += static_cast<size_t>(n);
+  }
+  buffer.resize(offset);
+}
+#endif
+
+} // namespace
+
+io::MappedFile::MappedFile(const std::filesystem::path& path, Mode mode)
+    : MappedFile(path, mode, 0, std::numeric_limits<size_t>::max()) {}
+
+io::MappedFile::MappedFile(const std::filesystem::path& path, Mode mode, size_t offset, size_t length) {
+#ifdef IO_HAS_MMAP
+  FileDescriptor file{::open(path.c_str(), O_RDONLY)};
+  if (file.fd < 0) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+
+  struct stat st {};
+  if (::fstat(file.fd, &st) != 0) {
+    throw std::runtime_error("Failed to stat file: " + path.string());
+  }
+  const auto file_size = static_cast<size_t>(st.st_size);
+  offset = std::min(offset, file_size);
+  size_ = std::min(length, file_size - offset);
+  if (size_ == 0) { return; }
+
+  if (mode == Mode::Map) {
+    // Отображение начинается с границы страницы: лишние байты перед offset пропускаются в view()
+    static const auto page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    skip_ = offset % page_size;
+    auto* mapping = ::mmap(nullptr, skip_ + size_, PROT_READ, MAP_PRIVATE, file.fd, static_cast<off_t>(offset - skip_));
+    if (mapping != MAP_FAILED) {
+      // Подсказки ядру необязательны: ошибки madvise не мешают чтению
+      ::madvise(mapping, skip_ + size_, MADV_SEQUENTIAL);
+      ::madvise(mapping, skip_ + size_, MADV_WILLNEED);
+      mapping_ = mapping;
+      return;
+    }
+    // mmap не поддерживается для этого файла - читаем обычным способом
+    skip_ = 0;
+  }
+
+  buffer_.resize(size_);
+  read_all(file.fd, buffer_, path, offset);
+  size_ = buffer_.size();
+#else
+  (void)mode;
+  std::ifstream file(path, std::ios::binary | std::ios::in);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+
+  const auto file_size = static_cast<size_t>(std::filesystem::file_size(path));
+  offset = std::min(offset, file_size);
+  size_ = std::min(length, file_size - offset);
+  buffer_.resize(size_);
+  if (!file.seekg(static_cast<std::streamoff>(offset)) || !file.read(buffer_.data(), static_cast<std::streamsize>(size_))) {
+    throw std::runtime_error("Failed to read file: " + path.string());
+  }
+#endif
+}
+
+io::MappedFile::~MappedFile() {
+#ifdef IO_HAS_MMAP
+  if (mapping_ != nullptr) {
+    ::munmap(mapping_, skip_ + size_);
+  }
+#endif
+}
+
+std::string_view io::MappedFile::view() const noexcept {
+  if (mapping_ != nullptr) {
+    return {static_cast<const char*>(mapping_) + skip_, size_};
+  }
+  return buffer_;
+}
+
+io::ChunkReader::ChunkReader(const std::filesystem::path& path, size_t chunk_size)
+    : file_(std::fopen(path.string().c_str(), "rb")) {
+  if (file_ == nullptr) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+  if (chunk_size == 0) {
+    std::fclose(file_);
+    throw std::invalid_argument("Chunk size must be positive");
+  }
+  // Собственный буфер FILE не нужен: читаем сразу в buffer_ без лишнего копирования
+  std::setvbuf(file_, nullptr, _IONBF, 0);
+  buffer_.resize(chunk_size);
+}
+
+io::ChunkReader::ChunkReader(std::FILE* file, size_t chunk_size) : file_(file), owned_(false) {
+  if (chunk_size == 0) {
+    throw std::invalid_argument("Chunk size must be positive");
+  }
+  // Без буфера FILE каждый fread превращается в крупные read() прямо в buffer_
+  std::setvbuf(file_, nullptr, _IONBF, 0);
+  buffer_.resize(chunk_size);
+}
+
+io::ChunkReader::~ChunkReader() {
+  if (owned_) {
+    std::fclose(file_);
+  }
+}
+
+std::string_view io::ChunkReader::next() {
+#if defined(IO_HAS_MMAP) && defined(POSIX_FADV_DONTNEED)
+  // Предыдущий блок уже обработан: сбрасываем его страницы, чтобы однократный проход не вытеснял
+  // из page cache данные других процессов. Поток, открытый не нами (stdin), не трогаем
+  if (owned_ && consumed_ > dropped_) {
+    ::posix_fadvise(::fileno(file_), static_cast<off_t>(dropped_), static_cast<off_t>(consumed_ - dropped_),
+                    POSIX_FADV_DONTNEED);
+    dropped_ = consumed_;
+  }
+#endif
+  auto n = std::fread(buffer_.data(), 1, buffer_.size(), file_);
+  if (n == 0 && std::ferror(file_)) {
+    throw std::runtime_error("Failed to read file");
+  }
+  consumed_ += n;
+  return {buffer_.data(), n};
+}
+
+#ifdef IO_HAS_URING
+/**
+ * Минимальная обёртка над системными вызовами io_uring (без liburing):
+ * отображённые в память очереди отправки (SQ) и завершения (CQ).
+ */
+struct io::RingReader::Ring {
+  static constexpr long Pending = -1;
+
+  int fd = -1;
+  void* sq_ring = MAP_FAILED;
+  size_t sq_ring_size = 0;
+  void* cq_ring = MAP_FAILED;
+  size_t cq_ring_size = 0;
+  io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t sqes_size = 0;
+
+  unsigned* sq_tail = nullptr;
+  unsigned* sq_mask = nullptr;
+  unsigned* sq_array = nullptr;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned* cq_mask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+
+  unsigned to_submit = 0;
+  // Запросы, поставленные в очередь и ещё не завершённые
+  unsigned in_flight = 0;
+  // Результат чтения для каждого буфера: Pending, пока запрос не завершён
+  std::vector<long> results;
+
+  explicit Ring(unsigned entries) : results(entries, Pending) {
+    io_uring_params params{};
+    fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      throw std::runtime_error("io_uring is unavailable");
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+      release();
+      throw std::runtime_error("Failed to map io_uring submission queue");
+    }
+    cq_ring = single_mmap ? sq_ring
+                          : ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                   IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(
+        ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+      release();
+      throw std::runtime_error("Failed to map io_uring completion queue");
+    }
+
+    auto sq = static_cast<char*>(sq_ring);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    auto cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  ~Ring() { release(); }
+
+  void release() noexcept {
+    if (sqes != MAP_FAILED) { ::munmap(sqes, sqes_size); }
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) { ::munmap(cq_ring, cq_ring_size); }
+    if (sq_ring != MAP_FAILED) { ::munmap(sq_ring, sq_ring_size); }
+    if (fd >= 0) { ::close(fd); }
+  }
+
+  // Ставит в очередь чтение в буфер slot; отправляется ядру в enter()
+  void prepare_read(unsigned slot, int file, char* buffer, unsigned length, size_t offset) {
+    // Очередь отправки заполняет только этот поток, поэтому свой tail читаем без синхронизации
+    const auto tail = *sq_tail;
+    const auto index = tail & *sq_mask;
+    auto& sqe = sqes[index];
+    sqe = io_uring_sqe{};
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = file;
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = length;
+    sqe.off = offset;
+    sqe.user_data = slot;
+    sq_array[index] = index;
+    std::atomic_ref(*sq_tail).store(tail + 1, std::memory_order_release);
+    results[slot] = Pending;
+    ++to_submit;
+    ++in_flight;
+  }
+
+  // Отправляет накопленные запросы и, если wait, ждёт хотя бы одно завершение
+  void enter(bool wait) {
+    const unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    if (to_submit == 0 && !wait) { return; }
+    long submitted = 0;
+    while ((submitted = ::syscall(__NR_io_uring_enter, fd, to_submit, wait ? 1 : 0, flags, nullptr, 0)) < 0) {
+      if (errno == EAGAIN || errno == EBUSY) {
+        // Ядру временно не хватает ресурсов или переполнена очередь завершений: освобождаем её и повторяем
+        reap();
+        std::this_thread::yield();
+      } else if (errno != EINTR) {
+        throw std::runtime_error("io_uring_enter failed");
+      }
+    }
+    // Ядро может принять только часть запросов: остальные остаются в SQ до следующего вызова
+    to_submit -= static_cast<unsigned>(submitted);
+  }
+
+  // Забирает все готовые завершения из очереди CQ
+  void reap() {
+    auto head = *cq_head;
+    const auto tail = std::atomic_ref(*cq_tail).load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      const auto& cqe = cqes[head & *cq_mask];
+      results[cqe.user_data] = cqe.res;
+      --in_flight;
+    }
+    std::atomic_ref(*cq_head).store(head, std::memory_order_release);
+  }
+
+  // Дожидается завершения всех запросов: только после этого их буферы можно освобождать
+  void drain() {
+    while (in_flight != 0) {
+      enter(true);
+      reap();
+    }
+  }
+};
+#else
+struct io::RingReader::Ring {};
+#endif
+
+io::RingReader::RingReader(const std::filesystem::path& path, size_t chunk_size, unsigned depth, bool direct)
+    : chunk_size_(chunk_size), depth_(std::max(depth, 1u)), buffers_(nullptr, std::free) {
+#ifdef IO_HAS_MMAP
+  if (chunk_size == 0) {
+    throw std::invalid_argument("Chunk size must be positive");
+  }
+#ifdef O_DIRECT
+  if (direct) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+    direct_ = fd_ >= 0;
+  }
+#endif
+  if (fd_ < 0) {
+    // O_DIRECT не поддерживается файловой системой (tmpfs и т.п.) или платформой
+    fd_ = ::open(path.c_str(), O_RDONLY);
+  }
+  if (fd_ < 0) {
+    throw std::runtime_error("Failed to open file: " + path.string());
+  }
+#ifdef F_NOCACHE
+  if (direct) {
+    direct_ = ::fcntl(fd_, F_NOCACHE, 1) == 0;
+  }
+#endif
+  // Без прямого чтения (не запрошено или не поддерживается) сбрасываем уже прочитанные страницы из page cache
+  drop_cache_ = !direct_;
+  struct stat st {};
+  if (::fstat(fd_, &st) != 0) {
+    ::close(fd_);
+    throw std::runtime_error("Failed to stat file: " + path.string());
+  }
+  file_size_ = static_cast<size_t>(st.st_size);
+
+  chunk_size_ = align_up(chunk_size_);
+  chunks_ = (file_size_ + chunk_size_ - 1) / chunk_size_;
+  buffers_.reset(static_cast<char*>(std::aligned_alloc(BlockAlignment, chunk_size_ * depth_)));
+  if (!buffers_) {
+    ::close(fd_);
+    throw std::bad_alloc();
+  }
+
+#ifdef IO_HAS_URING
+  try {
+    ring_ = std::make_unique<Ring>(depth_);
+  } catch (const std::runtime_error&) {
+    ring_.reset();  // работаем через pread
+  }
+  if (ring_) {
+    for (; submitted_ < std::min<size_t>(chunks_, depth_); ++submitted_) {
+      submit(submitted_);
+    }
+    ring_->enter(false);
+  }
+#endif
+#else
+  (void)path;
+  throw std::runtime_error("Chunked pread/io_uring input is not supported on this platform");
+#endif
+}
+
+io::RingReader::~RingReader() {
+#ifdef IO_HAS_URING
+  // Закрытие кольца не отменяет синхронно чтения, уже переданные ядром в io-wq: они могут писать
+  // в буферы и после close. Поэтому дожидаемся всех незавершённых запросов (не больше depth_)
+  if (ring_) {
+    try {
+      ring_->drain();
+    } catch (...) {
+      // Дождаться не удалось: оставляем буферы памяти процесса, чтобы ядро не писало в освобождённую память
+      (void)buffers_.release();
+    }
+  }
+#endif
+  ring_.reset();
+#ifdef IO_HAS_MMAP
+  if (fd_ >= 0) { ::close(fd_); }
+#endif
+}
+
+void io::RingReader::submit(size_t chunk) {
+#ifdef IO_HAS_URING
+  const auto slot = static_cast<unsigned>(chunk % depth_);
+  const auto offset = chunk * chunk_size_;
+  const auto length = read_length(std::min(chunk_size_, file_size_ - offset));
+  ring_->prepare_read(slot, fd_, buffers_.get() + slot * chunk_size_, static_cast<unsigned>(length), offset);
+#else
+  (void)chunk;
+#endif
+}
+
+std::string_view io::RingReader::next() {
+#ifdef IO_HAS_MMAP
+#ifdef POSIX_FADV_DONTNEED
+  // Предыдущий блок уже обработан: его страницы больше не нужны. Последний блок сбрасывается
+  // вызовом, который сообщает о конце файла
+  if (drop_cache_ && delivered_ > dropped_) {
+    const auto begin = dropped_ * chunk_size_;
+    ::posix_fadvise(fd_, static_cast<off_t>(begin), static_cast<off_t>(std::min(chunk_size_, file_size_ - begin)),
+                    POSIX_FADV_DONTNEED);
+    dropped_ = delivered_;
+  }
+#endif
+  if (delivered_ == chunks_) {
+    return {};
+  }
+
+  const auto slot = delivered_ % depth_;
+  const auto offset = delivered_ * chunk_size_;
+  const auto length = std::min(chunk_size_, file_size_ - offset);
+  auto buffer = buffers_.get() + slot * chunk_size_;
+  size_t done = 0;
+
+#ifdef IO_HAS_URING
+  if (ring_) {
+    // Буфер, отданный предыдущим вызовом, свободен: ставим в него чтение следующего блока
+    if (delivered_ > 0 && submitted_ < chunks_) {
+      submit(submitted_++);
+    }
+    ring_->enter(false);
+    ring_->reap();
+    while (ring_->results[slot] == Ring::Pending) {
+      ring_->enter(true);
+      ring_->reap();
+    }
+    if (ring_->results[slot] < 0) {
+      throw std::runtime_error("Failed to read file");
+    }
+    done = static_cast<size_t>(ring_->results[slot]);
+  }
+#endif
+
+  // Синхронное чтение: весь блок без io_uring либо остаток после короткого чтения
+  while (done < length) {
+    auto n = ::pread(fd_, buffer + done, read_length(length - done), static_cast<off_t>(offset + done));
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      throw std::runtime_error("Failed to read file");
+    }
+    if (n == 0) { break; }
+    done += static_cast<size_t>(n);
+  }
+
+  // При O_DIRECT читаем с запасом до границы блока
+  done = std::min(done, length);
+  ++delivered_;
+  consumed_ += done;
+  return {buffer, done};
+#else
+  return {};
+#endif
+}
+
+size_t io::RingReader::read_length(size_t length) const noexcept {
+  return direct_ ? align_up(length) : length;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// io - чтение входных данных
+namespace io {
+
+/**
+ * @brief Содержимое файла, доступное как непрерывный диапазон байт
+ *
+ * По умолчанию файл отображается в память (mmap) с подсказками ядру
+ * MADV_SEQUENTIAL и MADV_WILLNEED: данные читаются из page cache по мере обращения,
+ * RSS процесса ограничен page cache, а обработка начинается без ожидания полного чтения.
+ *
+ * Если mmap недоступен (платформа, тип файла, ошибка) или явно запрошен Mode::Read,
+ * файл целиком читается через read() во внутренний буфер.
+ */
+class MappedFile final {
+public:
+  enum class Mode { Map, Read };
+
+  explicit MappedFile(const std::filesystem::path& path, Mode mode = Mode::Map);
+  /// Только байты [offset, offset + length) файла (обрезаются по его концу)
+  MappedFile(const std::filesystem::path& path, Mode mode, size_t offset, size_t length);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  [[nodiscard]] std::string_view view() const noexcept;
+  [[nodiscard]] size_t size() const noexcept { return size_; }
+  [[nodiscard]] bool mapped() const noexcept { return mapping_ != nullptr; }
+
+private:
+  void* mapping_ = nullptr;
+  size_t skip_ = 0;  // байты отображения перед offset: mmap начинается с границы страницы
+  size_t size_ = 0;
+  std::string buffer_;
+};
+
+/**
+ * @brief Последовательное чтение файла блоками фиксированного размера
+ *
+ * Использует один переиспользуемый буфер размером chunk_size, поэтому память
+ * не зависит от размера входа, в том числе для каналов и stdin. Блоки режутся по байтам, без учёта utf-8 и слов:
+ * переносом хвостов занимается потребитель (uu::GroupStream).
+ *
+ * Страницы обработанных блоков файла сбрасываются из page cache (posix_fadvise(POSIX_FADV_DONTNEED)).
+ */
+class ChunkReader final {
+public:
+  ChunkReader(const std::filesystem::path& path, size_t chunk_size);
+  /// Читает уже открытый поток (например, stdin), не закрывая его; размер входа заранее не нужен
+  ChunkReader(std::FILE* file, size_t chunk_size);
+  ~ChunkReader();
+
+  ChunkReader(const ChunkReader&) = delete;
+  ChunkReader& operator=(const ChunkReader&) = delete;
+
+  /// Читает следующий блок; пустой блок означает конец файла. Предыдущий блок становится недействителен
+  [[nodiscard]] std::string_view next();
+  /// Количество прочитанных байт
+  [[nodiscard]] size_t consumed() const noexcept { return consumed_; }
+
+private:
+  std::FILE* file_ = nullptr;
+  bool owned_ = true;
+  std::string buffer_;
+  size_t consumed_ = 0;
+  size_t dropped_ = 0;  // начало ещё не сброшенных из page cache байт
+};
+
+/**
+ * @brief Чтение файла блоками через io_uring с несколькими буферами в полёте
+ *
+ * Пока потребитель декодирует очередной блок, ядро уже читает следующие depth - 1 блоков
+ * в свои буферы, так что ввод-вывод перекрывается с вычислениями. Блоки отдаются строго
+ * по порядку; буфер возвращённого блока переиспользуется при следующем вызове next().
+ * Буферы выровнены по 4096 байт.
+ *
+ * Если io_uring недоступен (ядро, seccomp, платформа), блоки читаются синхронно через pread.
+ *
+ * С direct файл открывается с O_DIRECT (F_NOCACHE на macOS), и однократный проход по корпусу
+ * не вытесняет из page cache данные других процессов. Без прямого чтения (не запрошено или
+ * невозможно) страницы каждого обработанного блока, включая последний, сбрасываются через
+ * posix_fadvise(POSIX_FADV_DONTNEED).
+ */
+class RingReader final {
+public:
+  RingReader(const std::filesystem::path& path, size_t chunk_size, unsigned depth = 4, bool direct = false);
+  ~RingReader();
+
+  RingReader(const RingReader&) = delete;
+  RingReader& operator=(const RingReader&) = delete;
+
+  /// Следующий блок по порядку; пустой блок означает конец файла
+  [[nodiscard]] std::string_view next();
+  [[nodiscard]] size_t consumed() const noexcept { return consumed_; }
+  /// true, если чтение идёт через io_uring, false - через pread
+  [[nodiscard]] bool async() const noexcept { return ring_ != nullptr; }
+  /// true, если чтение идёт в обход page cache
+  [[nodiscard]] bool direct() const noexcept { return direct_; }
+
+private:
+  struct Ring;
+
+  void submit(size_t chunk);
+  [[nodiscard]] size_t read_length(size_t length) const noexcept;
+
+  int fd_ = -1;
+  size_t file_size_ = 0;
+  size_t chunk_size_ = 0;
+  size_t chunks_ = 0;
+  unsigned depth_ = 0;
+  bool direct_ = false;
+  bool drop_cache_ = false;
+  std::unique_ptr<char, void (*)(void*)> buffers_;
+  std::unique_ptr<Ring> ring_;
+  size_t submitted_ = 0;
+  size_t delivered_ = 0;
+  size_t dropped_ = 0;  // блоки до dropped_ уже сброшены из page cache
+  size_t consumed_ = 0;
+};
+
+} // namespace io
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+
+// uu - Unicode Utilities
+namespace uu {
+
+/**
+ * @brief Письменность, буквы которой могут входить в слова
+ *
+ * Буквами считаются code points общей категории L* кроме Lm (модификаторы) из блоков письменности
+ * (Unicode 14.0). Таблицы покрывают только BMP: букв выбранных письменностей за её пределами почти нет.
+ */
+enum class Script : uint8_t { Latin, Cyrillic, Greek, Armenian, Georgian, Hebrew, Arabic };
+
+/**
+ * @brief Множество письменностей: бит i установлен для Script(i)
+ */
+class ScriptSet {
+ public:
+  constexpr ScriptSet() = default;
+  constexpr ScriptSet(std::initializer_list<Script> scripts) {
+    for (auto script : scripts) {
+      add(script);
+    }
+  }
+
+  constexpr ScriptSet& add(Script script) noexcept {
+    bits_ |= static_cast<uint8_t>(1u << static_cast<unsigned>(script));
+    return *this;
+  }
+  [[nodiscard]] constexpr bool contains(Script script) const noexcept {
+    return (bits_ >> static_cast<unsigned>(script)) & 1u;
+  }
+  [[nodiscard]] constexpr bool empty() const noexcept { return bits_ == 0; }
+  [[nodiscard]] constexpr uint8_t bits() const noexcept { return bits_; }
+
+ private:
+  uint8_t bits_ = 0;
+};
+
+namespace detail {
+
+struct CodePointRange {
+  uint32_t first;
+  uint32_t last;  // включительно
+};
+
+// Латиница, включая расширения A-E, IPA (U+0250..U+02AF), фонетические расширения и дополнение к ним,
+// перевёрнутые F и C из буквоподобных символов, полноширинные буквы, лигатуры ff-st
+inline constexpr CodePointRange LatinLetters[] = {
+    {0x0041, 0x005A}, {0x0061, 0x007A}, {0x00AA, 0x00AA}, {0x00BA, 0x00BA}, {0x00C0, 0x00D6}, {0x00D8, 0x00F6},
+    {0x00F8, 0x02AF}, {0x1D00, 0x1D25}, {0x1D6B, 0x1D77}, {0x1D79, 0x1D9A}, {0x1E00, 0x1EFF}, {0x2132, 0x2132},
+    {0x214E, 0x214E}, {0x2183, 0x2184}, {0x2C60, 0x2C7B}, {0x2C7E, 0x2C7F}, {0xA722, 0xA76F}, {0xA771, 0xA787},
+    {0xA78B, 0xA7CA}, {0xA7D0, 0xA7D1}, {0xA7D3, 0xA7D3}, {0xA7D5, 0xA7D9}, {0xA7F5, 0xA7F7}, {0xA7FA, 0xA7FF},
+    {0xAB30, 0xAB5A}, {0xAB60, 0xAB64}, {0xAB66, 0xAB68}, {0xFB00, 0xFB06}, {0xFF21, 0xFF3A}, {0xFF41, 0xFF5A}};
+
+// Кириллица целиком, в том числе Ё, украинские Є І Ї Ґ, белорусская Ў и расширения B, C
+inline constexpr CodePointRange CyrillicLetters[] = {
+    {0x0400, 0x0481}, {0x048A, 0x052F}, {0x1C80, 0x1C88}, {0xA640, 0xA66E}, {0xA680, 0xA69B}};
+
+// Греческий и коптский, расширенный греческий (политоника)
+inline constexpr CodePointRange GreekLetters[] = {
+    {0x0370, 0x0373}, {0x0376, 0x0377}, {0x037B, 0x037D}, {0x037F, 0x037F}, {0x0386, 0x0386}, {0x0388, 0x038A},
+    {0x038C, 0x038C}, {0x038E, 0x03A1}, {0x03A3, 0x03F5}, {0x03F7, 0x03FF}, {0x1F00, 0x1F15}, {0x1F18, 0x1F1D},
+    {0x1F20, 0x1F45}, {0x1F48, 0x1F4D}, {0x1F50, 0x1F57}, {0x1F59, 0x1F59}, {0x1F5B, 0x1F5B}, {0x1F5D, 0x1F5D},
+    {0x1F5F, 0x1F7D}, {0x1F80, 0x1FB4}, {0x1FB6, 0x1FBC}, {0x1FBE, 0x1FBE}, {0x1FC2, 0x1FC4}, {0x1FC6, 0x1FCC},
+    {0x1FD0, 0x1FD3}, {0x1FD6, 0x1FDB}, {0x1FE0, 0x1FEC}, {0x1FF2, 0x1FF4}, {0x1FF6, 0x1FFC}};
+
+inline constexpr CodePointRange ArmenianLetters[] = {{0x0531, 0x0556}, {0x0560, 0x0588}, {0xFB13, 0xFB17}};
+
+// Мхедрули, мтаврули и хуцури
+inline constexpr CodePointRange GeorgianLetters[] = {
+    {0x10A0, 0x10C5}, {0x10C7, 0x10C7}, {0x10CD, 0x10CD}, {0x10D0, 0x10FA}, {0x10FD, 0x10FF},
+    {0x1C90, 0x1CBA}, {0x1CBD, 0x1CBF}, {0x2D00, 0x2D25}, {0x2D27, 0x2D27}, {0x2D2D, 0x2D2D}};
+
+// Без огласовок: они относятся к категории Mn
+inline constexpr CodePointRange HebrewLetters[] = {
+    {0x05D0, 0x05EA}, {0x05EF, 0x05F2}, {0xFB1D, 0xFB1D}, {0xFB1F, 0xFB28}, {0xFB2A, 0xFB36},
+    {0xFB38, 0xFB3C}, {0xFB3E, 0xFB3E}, {0xFB40, 0xFB41}, {0xFB43, 0xFB44}, {0xFB46, 0xFB4F}};
+
+// Основной блок, дополнение, расширения A и B, формы представления A и B
+inline constexpr CodePointRange ArabicLetters[] = {
+    {0x0620, 0x063F}, {0x0641, 0x064A}, {0x066E, 0x066F}, {0x0671, 0x06D3}, {0x06D5, 0x06D5},
+    {0x06EE, 0x06EF}, {0x06FA, 0x06FC}, {0x06FF, 0x06FF}, {0x0750, 0x077F}, {0x0870, 0x0887},
+    {0x0889, 0x088E}, {0x08A0, 0x08C8}, {0xFB50, 0xFBB1}, {0xFBD3, 0xFD3D}, {0xFD50, 0xFD8F},
+    {0xFD92, 0xFDC7}, {0xFDF0, 0xFDFB}, {0xFE70, 0xFE74}, {0xFE76, 0xFEFC}};
+
+// Индекс - значение Script
+inline constexpr std::span<const CodePointRange> ScriptLetters[] = {
+    LatinLetters, CyrillicLetters, GreekLetters, ArmenianLetters, GeorgianLetters, HebrewLetters, ArabicLetters};
+
+// Число блоков BMP по 256 code points, в которых есть хотя бы одна буква
+constexpr size_t count_letter_blocks() {
+  std::array<bool, 256> used{};
+  for (auto letters : ScriptLetters) {
+    for (auto [first, last] : letters) {
+      for (auto block = first >> 8; block <= last >> 8; ++block) {
+        used[block] = true;
+      }
+    }
+  }
+  return static_cast<size_t>(std::ranges::count(used, true));
+}
+
+/**
+ * @brief Двухуровневая таблица букв
+ *
+ * index[cp >> 8] - номер строки blocks для блока BMP (0 - общая пустая строка для блоков без букв),
+ * blocks[row][cp & 0xFF] - маска письменностей (ScriptSet::bits()), буквой которых является cp.
+ * Каждый байт строки - это биты всех письменностей сразу, поэтому одна таблица годится для
+ * любого их набора.
+ */
+template<size_t Blocks>
+struct LetterTable {
+  std::array<uint8_t, 256> index{};
+  std::array<std::array<uint8_t, 256>, Blocks + 1> blocks{};
+};
+
+template<size_t Blocks>
+constexpr LetterTable<Blocks> make_letter_table() {
+  static_assert(Blocks < 256, "Номер строки должен помещаться в байт");
+
+  LetterTable<Blocks> table;
+  uint8_t rows = 1;
+  for (unsigned script = 0; script < std::size(ScriptLetters); ++script) {
+    for (auto [first, last] : ScriptLetters[script]) {
+      for (auto code_point = first; code_point <= last; ++code_point) {
+        auto& row = table.index[code_point >> 8];
+        if (row == 0) {
+          row = rows++;
+        }
+        table.blocks[row][code_point & 0xFF] |= static_cast<uint8_t>(1u << script);
+      }
+    }
+  }
+  return table;
+}
+
+inline constexpr auto Letters = make_letter_table<count_letter_blocks()>();
+
+} // namespace detail
+
+/**
+ * @brief Маска письменностей, буквой которых является code_point (0 - не буква)
+ *
+ * Два обращения к таблицам, не зависит от локали.
+ */
+constexpr uint8_t letter_scripts(uint32_t code_point) noexcept {
+  if (code_point > 0xFFFF) {
+    return 0;
+  }
+  return detail::Letters.blocks[detail::Letters.index[code_point >> 8]][code_point & 0xFF];
+}
+
+namespace detail {
+
+// Участок code points с одинаковым сдвигом при приведении регистра: first, first + stride, ... <= last
+struct CaseFoldRange {
+  uint32_t first;
+  uint32_t last;
+  int32_t delta;
+  uint32_t stride;
+};
+
+// Простое приведение регистра (статусы C и S в CaseFolding.txt, Unicode 14.0), только BMP
+inline constexpr CaseFoldRange CaseFolding[] = {
+    {0x0041, 0x005A, 32, 1}, {0x00B5, 0x00B5, 775, 1}, {0x00C0, 0x00D6, 32, 1}, {0x00D8, 0x00DE, 32, 1},
+    {0x0100, 0x012E, 1, 2}, {0x0132, 0x0136, 1, 2}, {0x0139, 0x0147, 1, 2}, {0x014A, 0x0176, 1, 2},
+    {0x0178, 0x0178, -121, 1}, {0x0179, 0x017D, 1, 2}, {0x017F, 0x017F, -268, 1}, {0x0181, 0x0181, 210, 1},
+    {0x0182, 0x0184, 1, 2}, {0x0186, 0x0186, 206, 1}, {0x0187, 0x0187, 1, 1}, {0x0189, 0x018A, 205, 1},
+    {0x018B, 0x018B, 1, 1}, {0x018E, 0x018E, 79, 1}, {0x018F, 0x018F, 202, 1}, {0x0190, 0x0190, 203, 1},
+    {0x0191, 0x0191, 1, 1}, {0x0193, 0x0193, 205, 1}, {0x0194, 0x0194, 207, 1}, {0x0196, 0x0196, 211, 1},
+    {0x0197, 0x0197, 209, 1}, {0x0198, 0x0198, 1, 1}, {0x019C, 0x019C, 211, 1}, {0x019D, 0x019D, 213, 1},
+    {0x019F, 0x019F, 214, 1}, {0x01A0, 0x01A4, 1, 2}, {0x01A6, 0x01A6, 218, 1}, {0x01A7, 0x01A7, 1, 1},
+    {0x01A9, 0x01A9, 218, 1}, {0x01AC, 0x01AC, 1, 1}, {0x01AE, 0x01AE, 218, 1}, {0x01AF, 0x01AF, 1, 1},
+    {0x01B1, 0x01B2, 217, 1}, {0x01B3, 0x01B5, 1, 2}, {0x01B7, 0x01B7, 219, 1}, {0x01B8, 0x01B8, 1, 1},
+    {0x01BC, 0x01BC, 1, 1}, {0x01C4, 0x01C4, 2, 1}, {0x01C5, 0x01C5, 1, 1}, {0x01C7, 0x01C7, 2, 1},
+    {0x01C8, 0x01C8, 1, 1}, {0x01CA, 0x01CA, 2, 1}, {0x01CB, 0x01DB, 1, 2}, {0x01DE, 0x01EE, 1, 2},
+    {0x01F1, 0x01F1, 2, 1}, {0x01F2, 0x01F4, 1, 2}, {0x01F6, 0x01F6, -97, 1}, {0x01F7, 0x01F7, -56, 1},
+    {0x01F8, 0x021E, 1, 2}, {0x0220, 0x0220, -130, 1}, {0x0222, 0x0232, 1, 2}, {0x023A, 0x023A, 10795, 1},
+    {0x023B, 0x023B, 1, 1}, {0x023D, 0x023D, -163, 1}, {0x023E, 0x023E, 10792, 1}, {0x0241, 0x0241, 1, 1},
+    {0x0243, 0x0243, -195, 1}, {0x0244, 0x0244, 69, 1}, {0x0245, 0x0245, 71, 1}, {0x0246, 0x024E, 1, 2},
+    {0x0345, 0x0345, 116, 1}, {0x0370, 0x0372, 1, 2}, {0x0376, 0x0376, 1, 1}, {0x037F, 0x037F, 116, 1},
+    {0x0386, 0x0386, 38, 1}, {0x0388, 0x038A, 37, 1}, {0x038C, 0x038C, 64, 1}, {0x038E, 0x038F, 63, 1},
+    {0x0391, 0x03A1, 32, 1}, {0x03A3, 0x03AB, 32, 1}, {0x03C2, 0x03C2, 1, 1}, {0x03CF, 0x03CF, 8, 1},
+    {0x03D0, 0x03D0, -30, 1}, {0x03D1, 0x03D1, -25, 1}, {0x03D5, 0x03D5, -15, 1}, {0x03D6, 0x03D6, -22, 1},
+    {0x03D8, 0x03EE, 1, 2}, {0x03F0, 0x03F0, -54, 1}, {0x03F1, 0x03F1, -48, 1}, {0x03F4, 0x03F4, -60, 1},
+    {0x03F5, 0x03F5, -64, 1}, {0x03F7, 0x03F7, 1, 1}, {0x03F9, 0x03F9, -7, 1}, {0x03FA, 0x03FA, 1, 1},
+    {0x03FD, 0x03FF, -130, 1}, {0x0400, 0x040F, 80, 1}, {0x0410, 0x042F, 32, 1}, {0x0460, 0x0480, 1, 2},
+    {0x048A, 0x04BE, 1, 2}, {0x04C0, 0x04C0, 15, 1}, {0x04C1, 0x04CD, 1, 2}, {0x04D0, 0x052E, 1, 2},
+    {0x0531, 0x0556, 48, 1}, {0x10A0, 0x10C5, 7264, 1}, {0x10C7, 0x10C7, 7264, 1}, {0x10CD, 0x10CD, 7264, 1},
+    {0x13F8, 0x13FD, -8, 1}, {0x1C80, 0x1C80, -6222, 1}, {0x1C81, 0x1C81, -6221, 1}, {0x1C82, 0x1C82, -6212, 1},
+    {0x1C83, 0x1C84, -6210, 1}, {0x1C85, 0x1C85, -6211, 1}, {0x1C86, 0x1C86, -6204, 1}, {0x1C87, 0x1C87, -6180, 1},
+    {0x1C88, 0x1C88, 35267, 1}, {0x1C90, 0x1CBA, -3008, 1}, {0x1CBD, 0x1CBF, -3008, 1}, {0x1E00, 0x1E94, 1, 2},
+    {0x1E9B, 0x1E9B, -58, 1}, {0x1E9E, 0x1E9E, -7615, 1}, {0x1EA0, 0x1EFE, 1, 2}, {0x1F08, 0x1F0F, -8, 1},
+    {0x1F18, 0x1F1D, -8, 1}, {0x1F28, 0x1F2F, -8, 1}, {0x1F38, 0x1F3F, -8, 1}, {0x1F48, 0x1F4D, -8, 1},
+    {0x1F59, 0x1F5F, -8, 2}, {0x1F68, 0x1F6F, -8, 1}, {0x1F88, 0x1F8F, -8, 1}, {0x1F98, 0x1F9F, -8, 1},
+    {0x1FA8, 0x1FAF, -8, 1}, {0x1FB8, 0x1FB9, -8, 1}, {0x1FBA, 0x1FBB, -74, 1}, {0x1FBC, 0x1FBC, -9, 1},
+    {0x1FBE, 0x1FBE, -7173, 1}, {0x1FC8, 0x1FCB, -86, 1}, {0x1FCC, 0x1FCC, -9, 1}, {0x1FD8, 0x1FD9, -8, 1},
+    {0x1FDA, 0x1FDB, -100, 1}, {0x1FE8, 0x1FE9, -8, 1}, {0x1FEA, 0x1FEB, -112, 1}, {0x1FEC, 0x1FEC, -7, 1},
+    {0x1FF8, 0x1FF9, -128, 1}, {0x1FFA, 0x1FFB, -126, 1}, {0x1FFC, 0x1FFC, -9, 1}, {0x2126, 0x2126, -7517, 1},
+    {0x212A, 0x212A, -8383, 1}, {0x212B, 0x212B, -8262, 1}, {0x2132, 0x2132, 28, 1}, {0x2160, 0x216F, 16, 1},
+    {0x2183, 0x2183, 1, 1}, {0x24B6, 0x24CF, 26, 1}, {0x2C00, 0x2C2F, 48, 1}, {0x2C60, 0x2C60, 1, 1},
+    {0x2C62, 0x2C62, -10743, 1}, {0x2C63, 0x2C63, -3814, 1}, {0x2C64, 0x2C64, -10727, 1}, {0x2C67, 0x2C6B, 1, 2},
+    {0x2C6D, 0x2C6D, -10780, 1}, {0x2C6E, 0x2C6E, -10749, 1}, {0x2C6F, 0x2C6F, -10783, 1},
+    {0x2C70, 0x2C70, -10782, 1}, {0x2C72, 0x2C72, 1, 1}, {0x2C75, 0x2C75, 1, 1}, {0x2C7E, 0x2C7F, -10815, 1},
+    {0x2C80, 0x2CE2, 1, 2}, {0x2CEB, 0x2CED, 1, 2}, {0x2CF2, 0x2CF2, 1, 1}, {0xA640, 0xA66C, 1, 2},
+    {0xA680, 0xA69A, 1, 2}, {0xA722, 0xA72E, 1, 2}, {0xA732, 0xA76E, 1, 2}, {0xA779, 0xA77B, 1, 2},
+    {0xA77D, 0xA77D, -35332, 1}, {0xA77E, 0xA786, 1, 2}, {0xA78B, 0xA78B, 1, 1}, {0xA78D, 0xA78D, -42280, 1},
+    {0xA790, 0xA792, 1, 2}, {0xA796, 0xA7A8, 1, 2}, {0xA7AA, 0xA7AA, -42308, 1}, {0xA7AB, 0xA7AB, -42319, 1},
+    {0xA7AC, 0xA7AC, -42315, 1}, {0xA7AD, 0xA7AD, -42305, 1}, {0xA7AE, 0xA7AE, -42308, 1},
+    {0xA7B0, 0xA7B0, -42258, 1}, {0xA7B1, 0xA7B1, -42282, 1}, {0xA7B2, 0xA7B2, -42261, 1}, {0xA7B3, 0xA7B3, 928, 1},
+    {0xA7B4, 0xA7C2, 1, 2}, {0xA7C4, 0xA7C4, -48, 1}, {0xA7C5, 0xA7C5, -42307, 1}, {0xA7C6, 0xA7C6, -35384, 1},
+    {0xA7C7, 0xA7C9, 1, 2}, {0xA7D0, 0xA7D0, 1, 1}, {0xA7D6, 0xA7D8, 1, 2}, {0xA7F5, 0xA7F5, 1, 1},
+    {0xAB70, 0xABBF, -38864, 1}, {0xFF21, 0xFF3A, 32, 1}};
+
+// Число блоков BMP по 256 code points, в которых регистр хотя бы одного символа меняется
+constexpr size_t count_case_fold_blocks() {
+  std::array<bool, 256> used{};
+  for (auto [first, last, delta, stride] : CaseFolding) {
+    for (auto block = first >> 8; block <= last >> 8; ++block) {
+      used[block] = true;
+    }
+  }
+  return static_cast<size_t>(std::ranges::count(used, true));
+}
+
+/**
+ * @brief Двухуровневая таблица приведения регистра
+ *
+ * Устроена как LetterTable, но строка хранит сдвиг по модулю 2^16: результат остаётся в BMP,
+ * поэтому fold(cp) = (cp + shift) & 0xFFFF, а нулевая строка оставляет символ как есть.
+ */
+template<size_t Blocks>
+struct CaseFoldTable {
+  std::array<uint8_t, 256> index{};
+  std::array<std::array<uint16_t, 256>, Blocks + 1> shifts{};
+};
+
+template<size_t Blocks>
+constexpr CaseFoldTable<Blocks> make_case_fold_table() {
+  static_assert(Blocks < 256, "Номер строки должен помещаться в байт");
+
+  CaseFoldTable<Blocks> table;
+  uint8_t rows = 1;
+  for (auto [first, last, delta, stride] : CaseFolding) {
+    for (auto code_point = first; code_point <= last; code_point += stride) {
+      auto& row = table.index[code_point >> 8];
+      if (row == 0) {
+        row = rows++;
+      }
+      table.shifts[row][code_point & 0xFF] = static_cast<uint16_t>(delta);
+    }
+  }
+  return table;
+}
+
+inline constexpr auto CaseFolds = make_case_fold_table<count_case_fold_blocks()>();
+
+} // namespace detail
+
+/**
+ * @brief Простое приведение регистра: "Слово" и "слово" дают одни и те же code points
+ *
+ * В отличие от полного (casefold), символ всегда переходит в один символ: ß остаётся ß,
+ * ẞ становится ß. Символы вне BMP не меняются.
+ */
+constexpr uint32_t fold_case(uint32_t code_point) noexcept {
+  if (code_point > 0xFFFF) {
+    return code_point;
+  }
+  const auto shift = detail::CaseFolds.shifts[detail::CaseFolds.index[code_point >> 8]][code_point & 0xFF];
+  return (code_point + shift) & 0xFFFF;
+}
+
+static_assert(fold_case(U'A') == U'a' && fold_case(U'Ё') == U'ё' && fold_case(U'Ґ') == U'ґ' && fold_case(U'Σ') == U'σ');
+static_assert(fold_case(U'ς') == U'σ' && fold_case(U'ẞ') == U'ß' && fold_case(U'ß') == U'ß' && fold_case(U'1') == U'1');
+
+/**
+ * @brief Предикат "буква одной из выбранных письменностей"
+ */
+class LetterSet {
+ public:
+  constexpr explicit LetterSet(ScriptSet scripts) noexcept : mask_(scripts.bits()) {}
+
+  constexpr bool operator()(uint32_t code_point) const noexcept { return (letter_scripts(code_point) & mask_) != 0; }
+
+ private:
+  uint8_t mask_;
+};
+
+} // namespace uu
@@ -10,13 +10,24 @@
 #include "tsqueue.h"
 #endif
 
+#include "bench.h"
+#include "corpus.h"
+#include "decompress.h"
+#include "input.h"
+#include "trigram.h"
 #include "util.h"
 #include "word.h"
 #include <algorithm>
+#include <array>
 #include <bitset>
+#include <charconv>
 #include <cctype>
 #include <fstream>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
 #include <string>
 #include <unordered_set>
 #include <utility>
@@ -25,269 +36,746 @@
 #include <ranges>
 #include <thread>
 #include <iomanip>
+#include <atomic>
 
 
-// Функция для проверки, является ли символ UTF-8 строчной буквой (русской или английской)
-bool islower_utf8(const std::string& s, size_t pos) {
-    if (pos >= s.size()) return false;
+using trigram::Trigram;
+using trigram::generate_trigrams;
 
-    unsigned char c = s[pos];
+#ifdef LF
+using Queue = lf::lf_queue<Trigram>;
+#elifdef AQ
+namespace {
+auto constexpr NIL = Trigram {4294967295};
+using Queue = atomic_queue::AtomicQueueB<Trigram, std::allocator<Trigram>, NIL>;
+}
+#else
+using Queue = ts::TSQueue<Trigram>;
+#endif
+
+/*
+template<>
+Trigram ts::Limiter<Trigram>() {
+  return Trigram{};
+}*/
+
+using Counter = std::unordered_map<uint64_t, int>;
 
-    // Английские строчные буквы
-    if (c >= 'a' && c <= 'z') return true;
+// Ошибка производителя не должна оставить потребителя без признака конца очереди
+void produce(Queue &q, const word::WordTable& words, std::exception_ptr &error) {
+  try {
+    // Генерируем триграммы для каждого слова
+    for (size_t i = 0; i < words.size(); ++i) {
+      auto trigrams = generate_trigrams(words[i]);
 
-    // Русские строчные буквы UTF-8 (2 байта)
-    if ((c & 0xE0) == 0xD0 && pos + 1 < s.size()) {
-        unsigned char c2 = s[pos + 1];
-        // Диапазон русских строчных букв в UTF-8 (D0 B0..D0 BF, D1 80..D1 8F)
-        return (c == 0xD0 && c2 >= 0xB0 && c2 <= 0xBF) ||
-               (c == 0xD1 && c2 >= 0x80 && c2 <= 0x8F);
+      while (not empty(trigrams)) {
+        q.push(trigrams.back());
+        trigrams.pop_back(); // std::this_thread::yield();
+      }
     }
+  } catch (...) {
+    error = std::current_exception();
+  }
 
-    return false;
+  q.push(Trigram{});
+  // q.push(ts::Limiter<Trigram>());
 }
 
-// Функция для приведения символа UTF-8 к нижнему регистру (русский и английский)
-void tolower_utf8(std::string& s, size_t pos) {
-    if (pos >= s.size()) return;
-
-    unsigned char c = s[pos];
+// После ошибки потребитель дочитывает очередь до конца, чтобы производитель не встал на полной очереди
+void consume(Queue &q, Counter &result, std::exception_ptr &error) {
+  while (true) {
+    auto value = q.pop();
+    if (value == Trigram{})
+      return;
 
-    // Английские заглавные буквы
-    if (c >= 'A' && c <= 'Z') {
-        s[pos] = c + 32;
-        return;
+    if (error) { continue; }
+    try {
+      result[value.value]++;
+    } catch (...) {
+      error = std::current_exception();
     }
+  }
+}
 
-    // Русские заглавные буквы UTF-8 (2 байта)
-    if ((c & 0xE0) == 0xD0 && pos + 1 < s.size()) {
-        unsigned char c2 = s[pos + 1];
-        // Диапазон русских заглавных букв в UTF-8 (D0 90..D0 9F, D0 81, D1 80..D1 8F)
-        if (c == 0xD0) {
-            if (c2 >= 0x90 && c2 <= 0x9F) {
-                s[pos + 1] = c2 + 0x20; // Сдвиг к строчным
-            } else if (c2 == 0x81) { // Буква Ё
-                s[pos] = 0xD1;
-                s[pos + 1] = 0x91;
-            }
-        } else if (c == 0xD1 && c2 >= 0x80 && c2 <= 0x8F) {
-            if (c2 == 0x80) { // Буква Ё (заглавная)
-                s[pos] = 0xD0;
-                s[pos + 1] = 0x81;
-            } else {
-                s[pos + 1] = c2 + 0x20; // Сдвиг к строчным
-            }
-        }
-    }
+// Sink для uu::GroupStream: считает триграммы каждого слова в result
+auto count_into(Counter &result) {
+  return [&result](std::span<const uu::UnicodeCodePoint> word) {
+    trigram::for_each_trigram(word, [&result](uint64_t value) { result[value]++; });
+  };
 }
 
-void encode_utf8(uint32_t code_point, std::string& out) {
-  if (code_point <= 0x7F) {  // 1 байт
-    out.push_back(static_cast<char>(code_point));
-  } else if (code_point <= 0x7FF) {  // 2 байта
-    out.push_back(static_cast<char>(0xC0 | ((code_point >> 6) & 0x1F)));
-    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
-  } else if (code_point <= 0xFFFF) {  // 3 байта
-    out.push_back(static_cast<char>(0xE0 | ((code_point >> 12) & 0x0F)));
-    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
-    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
-  } else if (code_point <= 0x10FFFF) {  // 4 байта
-    out.push_back(static_cast<char>(0xF0 | ((code_point >> 18) & 0x07)));
-    out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
-    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
-    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+/**
+ * Считает триграммы слов, которые feed(word_chars, sink) передаёт в sink
+ *
+ * word_chars - объект политики tokenizer: feed строит на нём токенизатор, специализированный под политику.
+ * С by_word слова сначала сводятся в word::WordCounter, а триграммы каждого различного слова
+ * порождаются один раз и добавляются с его частотой: частые слова текста не разбираются заново
+ * при каждом вхождении, и таблица триграмм обновляется в разы реже.
+ */
+template<typename Feed>
+void count_words(Counter &result, trigram::Tokenizer tokenizer, bool by_word, Feed feed) {
+  if (not by_word) {
+    trigram::visit(tokenizer, [&](auto word_chars) { feed(word_chars, count_into(result)); });
+    return;
   }
-  // Игнорируем некорректные символы (по желанию можно добавить обработку ошибок)
+  word::WordCounter words;
+  trigram::visit(tokenizer, [&](auto word_chars) {
+    feed(word_chars, [&words](std::span<const uu::UnicodeCodePoint> word) { words.add(word); });
+  });
+  words.for_each([&result](word::WordCounter::View word, size_t count) {
+    trigram::for_each_trigram(word, [&result, count](uint64_t value) { result[value] += static_cast<int>(count); });
+  });
 }
 
+// Граница слов политики tokenizer, см. uu::next_group_boundary
+size_t word_boundary(std::string_view input, size_t pos, trigram::Tokenizer tokenizer, uu::OnInvalid policy,
+                     bool fold_case, uu::Encoding encoding) {
+  return trigram::visit(tokenizer, [&](auto word_chars) {
+    return uu::next_group_boundary(input, pos, word_chars, policy, fold_case, encoding);
+  });
+}
 
-struct Trigram {
-  auto constexpr operator<=>(const Trigram &) const = default;
-  std::string to_utf8() const {
-    std::string result;
-
-    // Извлекаем 3 символа (21 бит каждый)
-    uint32_t char1 = (value >> 42) & 0x1FFFFF;  // Старшие 21 бит
-    uint32_t char2 = (value >> 21) & 0x1FFFFF;  // Средние 21 бит
-    uint32_t char3 = value & 0x1FFFFF;          // Младшие 21 бит
-
-    // Кодируем каждый символ в UTF-8 и добавляем в строку
-    encode_utf8(char1, result);
-    encode_utf8(char2, result);
-    encode_utf8(char3, result);
-
-    return result;
+// Сливает таблицы потоков в самую большую из них
+Counter merge(std::vector<Counter> &tables) {
+  Counter result;
+  result.swap(*std::ranges::max_element(tables, {}, &Counter::size));
+  for (auto &table : tables) {
+    for (const auto &[value, count] : table) {
+      result[value] += count;
+    }
   }
-  uint64_t value;
-};
-
-#ifdef LF
-using Queue = lf::lf_queue<Trigram>;
-#elifdef AQ
-namespace {
-auto constexpr NIL = Trigram {4294967295};
-using Queue = atomic_queue::AtomicQueueB<Trigram, std::allocator<Trigram>, NIL>;
+  return result;
 }
-#else
-using Queue = ts::TSQueue<Trigram>;
-#endif
 
-// Функция для извлечения триграмм из слова
-using Trigrams = std::vector<Trigram>;
-Trigrams generate_trigrams(word::Word&& word) {
-  assert(not word.empty());
-
-  switch (auto size = word.size(); size) {
-    case 1: { // [_][w0][_]
-      auto trigram_value = (static_cast<uint64_t>(0x20) << 42) | 0x20;
-      trigram_value |= static_cast<uint64_t>(word[0]) << 21;
-      Trigrams result; result.reserve(1);result.emplace_back(trigram_value);
-      return result;
+/**
+ * Считает триграммы входа, читаемого блоками: reader.next() возвращает очередной блок,
+ * пустой блок означает конец входа
+ *
+ * @param policy Что делать с некорректным utf-8
+ * @param fold_case Приводить регистр при декодировании
+ * @param encoding Кодировка входа
+ * @param tokenizer Какие символы составляют слово
+ * @param by_word Сначала свести слова в частоты, см. count_words
+ * @param engine Если не nullptr, сюда записывается объём входа, обработанный каждым декодером
+ * @return Количество прочитанных байт
+ */
+template<typename Reader>
+size_t count_stream(Reader &reader, Counter &result, uu::OnInvalid policy, bool fold_case, uu::Encoding encoding,
+                    trigram::Tokenizer tokenizer, bool by_word, uu::EngineStats *engine = nullptr) {
+  count_words(result, tokenizer, by_word, [&](auto word_chars, auto sink) {
+    uu::GroupStream grouper(word_chars, std::move(sink), policy);
+    grouper.set_fold_case(fold_case);
+    grouper.set_encoding(encoding);
+    for (auto chunk = reader.next(); not empty(chunk); chunk = reader.next()) {
+      grouper.feed(chunk);
     }
-    case 2: { // [w0][w1][_]
-      auto trigram_value = static_cast<uint64_t>(0x20);
-      trigram_value |= static_cast<uint64_t>(word[0]) << 42;
-      trigram_value |= static_cast<uint64_t>(word[1]) << 21;
-      Trigrams result; result.reserve(1);result.emplace_back(trigram_value);
-      return result;
+    grouper.finish();
+    if (engine != nullptr) {
+      *engine = grouper.engine_stats();
     }
-    default: {
-      Trigrams result; result.reserve(size);
-      for (size_t i = 0; i < size - 2; ++i) {
-        auto trigram_value = static_cast<uint64_t>(word[i]);
-        trigram_value |= static_cast<uint64_t>(word[i+1]) << 42;
-        trigram_value |= static_cast<uint64_t>(word[i+2]) << 21;
-        result.emplace_back(trigram_value);
-      }
-      {
-        auto trigram_value = static_cast<uint64_t>(0x20);
-        trigram_value |= static_cast<uint64_t>(word[size-1]) << 42;
-        trigram_value |= static_cast<uint64_t>(word[size-2]) << 21;
-        result.emplace_back(trigram_value);
+  });
+  return reader.consumed();
+}
+
+/**
+ * Считает триграммы input на threads потоках
+ *
+ * Вход делится на threads диапазонов примерно равного размера, границы сдвигаются
+ * к ближайшему символу-разделителю, так что ни слово, ни символ utf-8 не разрезаются.
+ * Каждый поток считает свой диапазон в собственную таблицу, затем таблицы сливаются.
+ *
+ * @param validated input прошёл uu::validate_utf8: диапазоны декодируются без проверок
+ */
+Counter count_parallel(std::string_view input, unsigned threads, uu::OnInvalid policy, bool fold_case,
+                       uu::Encoding encoding, trigram::Tokenizer tokenizer, bool validated, bool by_word) {
+  std::vector<size_t> bounds{0};
+  for (unsigned i = 1; i < threads; ++i) {
+    auto pos = std::max(bounds.back(), input.size() / threads * i);
+    bounds.push_back(word_boundary(input, pos, tokenizer, policy, fold_case, encoding));
+  }
+  bounds.push_back(input.size());
+
+  std::vector<Counter> tables(threads);
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.emplace_back([&, i] {
+      try {
+        count_words(tables[i], tokenizer, by_word, [&](auto word_chars, auto sink) {
+          uu::GroupStream grouper(word_chars, std::move(sink), policy);
+          grouper.set_fold_case(fold_case);
+          grouper.set_encoding(encoding);
+          grouper.set_validated(validated);
+          grouper.feed(input.substr(bounds[i], bounds[i + 1] - bounds[i]));
+          grouper.finish();
+        });
+      } catch (const uu::InvalidUtf8 &e) {
+        errors[i] = std::make_exception_ptr(e.shifted(bounds[i]));
+      } catch (...) {
+        errors[i] = std::current_exception();
       }
-      {
-        auto trigram_value = static_cast<uint64_t>(0x20) << 42;
-        trigram_value |= static_cast<uint64_t>(word[0]) << 21;
-        trigram_value |= static_cast<uint64_t>(word[1]);
-        result.emplace_back(trigram_value);
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (auto &error : errors) {
+    if (error) { std::rethrow_exception(error); }
+  }
+
+  return merge(tables);
+}
+
+/**
+ * Считает триграммы input двумя потоками через очередь (--pipeline)
+ *
+ * Вход сначала разбирается в word::WordTable (uu::group_spans), затем производитель порождает
+ * триграммы слов и передаёт их через очередь потребителю, который ведёт таблицу.
+ */
+Counter count_pipeline(std::string_view input, uu::OnInvalid policy, bool fold_case, uu::Encoding encoding,
+                       trigram::Tokenizer tokenizer, bool validated) {
+  // Разбиваем строку на слова
+  word::WordTable words(input.size());
+  trigram::visit(tokenizer, [&](auto word_chars) {
+    uu::group_spans(cbegin(input), cend(input), words.buffer(), std::back_inserter(words), word_chars, policy,
+                    fold_case, validated, encoding);
+  });
+
+  Counter result;
+  Queue queue(1024);
+  std::exception_ptr produce_error, consume_error;
+
+  std::thread producer(produce, std::ref(queue), std::cref(words), std::ref(produce_error));
+  std::thread consumer(consume, std::ref(queue), std::ref(result), std::ref(consume_error));
+
+  producer.join();
+  consumer.join();
+  for (auto &error : {produce_error, consume_error}) {
+    if (error) { std::rethrow_exception(error); }
+  }
+  return result;
+}
+
+/**
+ * Считает триграммы корпуса из нескольких файлов и каталогов на threads потоках
+ *
+ * Потоки разбирают задачи io::plan_corpus по одной, каждый считает в свою таблицу.
+ * Диапазоны частей крупного файла выравниваются по границам слов так же, как в count_parallel.
+ *
+ * @param mode Отображать файлы в память или читать read() (--no-mmap). Часть крупного файла
+ *             отображается или читается только в пределах своего диапазона
+ * @param chunk_size, queue_depth Блок и число блоков в пути для распаковки сжатых файлов
+ */
+Counter count_corpus(const std::vector<io::CorpusTask> &tasks, unsigned threads, uu::OnInvalid policy,
+                     bool fold_case, uu::Encoding encoding, trigram::Tokenizer tokenizer, bool by_word,
+                     io::MappedFile::Mode mode, size_t chunk_size, unsigned queue_depth) {
+  // Запас за концом диапазона для поиска границы слова
+  constexpr size_t BoundaryMargin = 64 << 10;
+  std::atomic<size_t> next_task{0};
+  std::vector<Counter> tables(threads);
+  std::vector<std::exception_ptr> errors(threads);
+
+  auto work = [&](unsigned i) {
+    try {
+      for (auto task = next_task++; task < tasks.size(); task = next_task++) {
+        for (const auto &range : tasks[task]) {
+          size_t begin = 0;
+          try {
+            if (auto compression = io::detect_compression(range.path); compression != io::Compression::None) {
+              // Сжатые файлы plan_corpus не режет: распаковываем целиком
+              io::DecompressReader reader(range.path, compression, chunk_size, queue_depth);
+              count_stream(reader, tables[i], policy, fold_case, encoding, tokenizer, by_word);
+              continue;
+            }
+
+            // Читаем только свой диапазон и запас за его концом, где ищется граница слова; слово длиннее
+            // запаса встречается редко, тогда запас удваивается
+            const bool last = range.end >= range.file_size;
+            std::optional<io::MappedFile> file;
+            std::string_view input;
+            size_t end = 0;
+            for (size_t margin = BoundaryMargin;; margin *= 2) {
+              const auto length = last ? range.file_size - range.begin : range.end - range.begin + margin;
+              file.emplace(range.path, mode, range.begin, length);
+              input = file->view();
+              end = last ? input.size()
+                         : word_boundary(input, range.end - range.begin, tokenizer, policy, fold_case, encoding);
+              if (last || end < input.size() || input.size() < length) { break; }
+            }
+            begin = range.begin == 0 ? 0 : word_boundary(input, 0, tokenizer, policy, fold_case, encoding);
+            if (begin >= end) { continue; }
+
+            count_words(tables[i], tokenizer, by_word, [&](auto word_chars, auto sink) {
+              uu::GroupStream grouper(word_chars, std::move(sink), policy);
+              grouper.set_fold_case(fold_case);
+              grouper.set_encoding(encoding);
+              grouper.feed(input.substr(begin, end - begin));
+              grouper.finish();
+            });
+          } catch (const uu::InvalidUtf8 &e) {
+            throw std::runtime_error(range.path.string() + ": " + e.shifted(range.begin + begin).what());
+          }
+        }
       }
-      return result;
+    } catch (...) {
+      errors[i] = std::current_exception();
+      next_task = tasks.size();
     }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (unsigned i = 1; i < threads; ++i) {
+    workers.emplace_back(work, i);
+  }
+  work(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (auto &error : errors) {
+    if (error) { std::rethrow_exception(error); }
   }
 
-  return {};
+  return merge(tables);
 }
 
-constexpr bool is_russian(uint32_t code_point) {
-  // Русские буквы в Unicode
-  return (code_point >= 0x0410 && code_point <= 0x044F) ||  // А-я (без Ё/ё)
-         (code_point == 0x0451) ||                         // ё
-         (code_point == 0x0401);                           // Ё
+// Позиция сразу после ближайшего разделителя документов, начиная с pos - 1
+size_t next_document(std::string_view input, size_t pos, char delimiter) {
+  if (pos == 0 || pos >= input.size()) {
+    return std::min(pos, input.size());
+  }
+  auto found = input.find(delimiter, pos - 1);
+  return found == std::string_view::npos ? input.size() : found + 1;
 }
-/*
-template<>
-Trigram ts::Limiter<Trigram>() {
-  return Trigram{};
-}*/
 
-void produce(Queue &q, std::vector<word::Word>&& words) {
-    // Генерируем триграммы для каждого слова
-    for (;not empty(words); words.pop_back()) {
-      auto word = std::move(words.back());
-      if (std::empty(word)) { continue; }
-
-      auto trigrams = generate_trigrams(std::move(word));
+// Дописывает вектор документа строкой "id:count id:count ...\n"
+void format_vector(const trigram::TextVector &vector, std::string &out) {
+  std::array<char, 32> buffer;
+  for (size_t i = 0; i < vector.size(); ++i) {
+    auto end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), vector.ids[i]).ptr;
+    *end++ = ':';
+    end = std::to_chars(end, buffer.data() + buffer.size(), vector.counts[i]).ptr;
+    *end++ = i + 1 == vector.size() ? '\n' : ' ';
+    out.append(buffer.data(), end);
+  }
+  if (vector.empty()) {
+    out.push_back('\n');
+  }
+}
 
-      while (not empty(trigrams)) {
-        q.push(trigrams.back());
-        trigrams.pop_back(); // std::this_thread::yield();
+/**
+ * Пишет в out вектор триграмм (trigram::TextVector) каждого документа input, по строке на документ
+ *
+ * Документы разделены delimiter. Вход обрабатывается окнами по window байт: окно делится
+ * между threads потоками по границам документов, каждый поток форматирует свои документы
+ * в отдельную строку, затем строки пишутся по порядку. Память ограничена размером окна.
+ *
+ * @return Количество документов
+ */
+size_t write_documents(std::string_view input, char delimiter, unsigned threads, uu::OnInvalid policy, bool fold_case,
+                       uu::Encoding encoding, trigram::Tokenizer tokenizer, std::ostream &out) {
+  constexpr size_t Window = 64 << 20;
+
+  size_t documents = 0;
+  std::vector<std::string> parts(threads);
+  std::vector<size_t> counts(threads);
+  std::vector<std::exception_ptr> errors(threads);
+  for (size_t window_begin = 0; window_begin < input.size();) {
+    const auto window_end = next_document(input, window_begin + Window, delimiter);
+    const auto window_size = window_end - window_begin;
+
+    std::vector<size_t> bounds{window_begin};
+    for (unsigned i = 1; i < threads; ++i) {
+      bounds.push_back(std::max(bounds.back(), next_document(input, window_begin + window_size / threads * i, delimiter)));
+    }
+    bounds.push_back(window_end);
+
+    auto work = [&](unsigned i) {
+      parts[i].clear();
+      counts[i] = 0;
+      for (auto begin = bounds[i]; begin < bounds[i + 1]; ++counts[i]) {
+        auto end = std::min(input.find(delimiter, begin), bounds[i + 1]);
+        try {
+          format_vector(trigram::generate_trigrams(input.substr(begin, end - begin), policy, fold_case, encoding, tokenizer),
+                        parts[i]);
+        } catch (const uu::InvalidUtf8 &e) {
+          errors[i] = std::make_exception_ptr(e.shifted(begin));
+          return;
+        } catch (...) {
+          errors[i] = std::current_exception();
+          return;
+        }
+        begin = end + 1;
       }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+      workers.emplace_back(work, i);
+    }
+    work(0);
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    for (auto &error : errors) {
+      if (error) { std::rethrow_exception(error); }
     }
 
-    q.push(Trigram{});
-    // q.push(ts::Limiter<Trigram>());
+    for (unsigned i = 0; i < threads; ++i) {
+      out << parts[i];
+      documents += counts[i];
+    }
+    window_begin = window_end;
+  }
+  return documents;
 }
 
-void consume(Queue &q, std::unordered_map<uint64_t, int> &result) {
-  while (true) {
-    auto value = q.pop();
-    if (value == Trigram{})
-      return;
+// Печатает преобладающий декодер и объём входа по декодерам
+void print_engine(const uu::EngineStats &engine) {
+  std::cout << "Kernels: " << uu::to_string(uu::kernels().isa) << '\n';
+  std::cout << "Engine: " << uu::to_string(engine.dominant()) << " (";
+  for (auto e : {uu::Engine::Ascii, uu::Engine::TwoByte, uu::Engine::Utf8, uu::Engine::CodePage}) {
+    if (e == uu::Engine::CodePage && engine.bytes[static_cast<size_t>(e)] == 0) {
+      continue;
+    }
+    std::cout << (e == uu::Engine::Ascii ? "" : ", ") << uu::to_string(e) << ": "
+              << engine.bytes[static_cast<size_t>(e)] << " bytes";
+  }
+  std::cout << ")\n";
+}
 
-    result[value.value]++;
+void print_stats(const Counter &result, Timer &t) {
+  uint64_t total = 0;
+  for (const auto &[_, count] : result) {
+    total += count;
   }
+  std::cout << '\n';
+  std::cout << "Time: " << t.elapsed_ms() << '\n';
+  std::cout << "Trigrams: " << total << " (unique: " << result.size() << ")\n";
 }
 
 int main(int argc, char** argv) {
   CLI::App app{"File reader with size output"};
 
-  std::string file_path;
-  app.add_option("file", file_path, "Path to the text file")
+  std::vector<std::string> paths;
+  app.add_option("paths", paths, "Text files or directories (scanned recursively), '-' for stdin")
       ->required()
-      ->check(CLI::ExistingFile);
+      ->check(CLI::ExistingPath | CLI::IsMember({"-"}));
+
+  size_t batch_size = 16 << 20;
+  app.add_option("--batch-size", batch_size, "Small files are grouped into tasks of about this size")
+      ->transform(CLI::AsSizeValue(false))
+      ->capture_default_str();
+
+  size_t split_size = 256 << 20;
+  app.add_option("--split-size", split_size, "Files larger than this are split between threads")
+      ->transform(CLI::AsSizeValue(false))
+      ->check(CLI::PositiveNumber)
+      ->capture_default_str();
+
+  bool no_mmap = false;
+  app.add_flag("--no-mmap", no_mmap, "Read the whole file into memory instead of mapping it");
+
+  bool stream = false;
+  app.add_flag("--stream", stream, "Read the file in fixed-size chunks and count trigrams on the fly");
+
+  size_t chunk_size = 1 << 20;
+  app.add_option("--chunk-size", chunk_size, "Chunk size for --stream, --io-uring, stdin and decompression (e.g. 64KB, 4MB)")
+      ->transform(CLI::AsSizeValue(false))
+      ->capture_default_str();
+
+  bool io_uring = false;
+  app.add_flag("--io-uring", io_uring, "Stream the file through io_uring with several reads in flight");
+
+  bool direct = false;
+  app.add_flag("--direct", direct, "Stream the file with O_DIRECT (implies --io-uring) to keep the page cache intact");
+
+  unsigned queue_depth = 4;
+  app.add_option("--queue-depth", queue_depth, "Number of chunk buffers in flight for --io-uring and decompression")
+      ->check(CLI::Range(1u, 4096u))
+      ->capture_default_str();
+
+  bool per_document = false;
+  app.add_flag("--per-document", per_document,
+               "Print a sparse trigram vector (id:count, sorted by id) per document instead of one table");
+
+  char delimiter = '\n';
+  app.add_option("--delimiter", delimiter, "Document delimiter for --per-document")
+      ->capture_default_str();
+
+  std::string output_path;
+  app.add_option("-o,--output", output_path, "Write --per-document vectors to this file instead of stdout");
+
+  unsigned threads = 1;
+  app.add_option("-j,--threads", threads, "Split the file into ranges counted on this many threads (0 - all cores)")
+      ->capture_default_str();
+
+  auto on_invalid = uu::OnInvalid::Replace;
+  const std::map<std::string, uu::OnInvalid> on_invalid_names{
+      {"skip", uu::OnInvalid::Skip}, {"replace", uu::OnInvalid::Replace}, {"stop", uu::OnInvalid::Stop}};
+  app.add_option("--on-invalid", on_invalid,
+                 "Invalid utf-8: skip it, replace it with U+FFFD (a separator) or stop with its byte offset")
+      ->transform(CLI::CheckedTransformer(on_invalid_names, CLI::ignore_case))
+      ->capture_default_str();
+
+  std::string encoding_name = "utf-8";
+  const std::map<std::string, uu::Encoding> encodings{{"utf-8", uu::Encoding::Utf8},
+                                                      {"cp1251", uu::Encoding::Cp1251},
+                                                      {"koi8-r", uu::Encoding::Koi8r},
+                                                      {"latin1", uu::Encoding::Latin1}};
+  app.add_option("--encoding", encoding_name, "Input encoding; single-byte ones are mapped byte by byte")
+      ->transform(CLI::IsMember(encodings, CLI::ignore_case))
+      ->capture_default_str();
+
+  bool pipeline = false;
+  app.add_flag("--pipeline", pipeline,
+               "Split the file into a word table first, then generate and count trigrams on two threads through a queue");
+
+  bool validate = false;
+  app.add_flag("--validate", validate,
+               "Check the whole file for invalid utf-8 first; a valid file is then decoded without checks");
+
+  bool fold_case = false;
+  app.add_flag("--fold-case", fold_case, "Count case-insensitively: fold every letter to its simple case folding");
+
+  bool by_word = false;
+  app.add_flag("--by-word", by_word,
+               "Count distinct words first, then generate trigrams once per distinct word");
+
+  auto tokenizer = trigram::Tokenizer::Letters;
+  const std::map<std::string, trigram::Tokenizer> tokenizer_names{
+      {"letters", trigram::Tokenizer::Letters},       {"alnum", trigram::Tokenizer::Alnum},
+      {"identifier", trigram::Tokenizer::Identifier}, {"apostrophe", trigram::Tokenizer::Apostrophe},
+      {"hyphen", trigram::Tokenizer::Hyphen}};
+  app.add_option("--word-chars", tokenizer,
+                 "Word characters: letters, alnum (letters and ASCII digits), identifier (alnum and '_'), "
+                 "apostrophe (letters and ' or U+2019) or hyphen (letters and '-')")
+      ->transform(CLI::CheckedTransformer(tokenizer_names, CLI::ignore_case))
+      ->capture_default_str();
+
+  std::vector<uu::Script> scripts{uu::Script::Latin, uu::Script::Cyrillic};
+  const std::map<std::string, uu::Script> script_names{
+      {"latin", uu::Script::Latin},       {"cyrillic", uu::Script::Cyrillic}, {"greek", uu::Script::Greek},
+      {"armenian", uu::Script::Armenian}, {"georgian", uu::Script::Georgian}, {"hebrew", uu::Script::Hebrew},
+      {"arabic", uu::Script::Arabic}};
+  app.add_option("--scripts", scripts, "Comma-separated scripts whose letters make up words [latin,cyrillic]")
+      ->delimiter(',')
+      ->transform(CLI::CheckedTransformer(script_names, CLI::ignore_case));
+
+  std::string force_isa;
+  const std::map<std::string, uu::Isa> isa_names{
+      {"scalar", uu::Isa::Scalar}, {"sse4.2", uu::Isa::Sse42}, {"avx2", uu::Isa::Avx2},
+      {"avx512", uu::Isa::Avx512}, {"neon", uu::Isa::Neon}};
+  app.add_option("--force-isa", force_isa, "Use these vector kernels instead of the best ones for this CPU")
+      ->transform(CLI::IsMember(isa_names, CLI::ignore_case));
+
+  unsigned bench_repeats = 0;
+  app.add_option("--bench-decoder", bench_repeats,
+                 "Instead of counting, time the scalar and vector utf-8 decoders over the file this many times")
+      ->check(CLI::Range(1u, 1000u));
+  unsigned bench_views_repeats = 0;
+  app.add_option("--bench-views", bench_views_repeats,
+                 "Instead of counting, time the range adaptor pipeline against hand-written loops this many times")
+      ->check(CLI::Range(1u, 1000u));
 
   try {
     CLI11_PARSE(app, argc, argv);
 
-    // Открываем файл в бинарном режиме для точного определения размера
-    std::ifstream file(file_path, std::ios::binary | std::ios::in);
-    if (!file.is_open()) {
-      throw std::runtime_error("Failed to open file: " + file_path);
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
     }
+    if (not force_isa.empty()) {
+      uu::force_isa(isa_names.at(force_isa));
+    }
+    uu::ScriptSet word_scripts;
+    for (auto script : scripts) {
+      word_scripts.add(script);
+    }
+    trigram::set_scripts(word_scripts);
 
-    // Получаем размер файла
-    auto file_size = std::filesystem::file_size(file_path);
+    const auto encoding = encodings.at(encoding_name);
+    if (validate && (encoding != uu::Encoding::Utf8 || stream || io_uring || direct || per_document || paths.size() != 1 || paths.front() == "-" ||
+                     not std::filesystem::is_regular_file(paths.front()) ||
+                     io::detect_compression(std::filesystem::path{paths.front()}) != io::Compression::None)) {
+      throw std::runtime_error("--validate needs a single uncompressed utf-8 file counted in memory");
+    }
+    if (pipeline && (by_word || threads != 1 || stream || io_uring || direct || per_document || paths.size() != 1 ||
+                     paths.front() == "-" || not std::filesystem::is_regular_file(paths.front()) ||
+                     io::detect_compression(std::filesystem::path{paths.front()}) != io::Compression::None)) {
+      throw std::runtime_error("--pipeline needs a single uncompressed file counted in memory with -j 1 and no --by-word");
+    }
 
-    // Читаем содержимое файла (опционально)
-    std::string input; input.resize(file_size);
-    if (!file.read(input.data(), file_size)) {
-      throw std::runtime_error("Failed to read file: " + file_path);
+    // Поток со стандартного ввода: размер заранее неизвестен, читаем блоками в один буфер
+    if (std::ranges::find(paths, "-") != end(paths)) {
+      if (paths.size() > 1 || io_uring || direct || per_document) {
+        throw std::runtime_error("stdin input ('-') accepts no other paths, --io-uring, --direct or --per-document");
+      }
+      Timer t; t.start();
+      Counter result;
+      uu::EngineStats engine;
+      io::ChunkReader reader(stdin, chunk_size);
+      auto consumed = count_stream(reader, result, on_invalid, fold_case, encoding, tokenizer, by_word, &engine);
+      t.stop();
+
+      std::cout << "Input size: " << consumed << " bytes\n";
+      print_engine(engine);
+      print_stats(result, t);
+      return 0;
     }
 
-    // Выводим размер файла
-    std::cout << "File size: " << file_size << " bytes\n";
-    Timer t; t.start();
-    // Разбиваем строку на слова
-    std::vector<word::Word> words;
-    words.reserve(265535);
+    // Несколько файлов или каталоги: корпус с параллелизмом по файлам
+    if (paths.size() > 1 || not std::filesystem::is_regular_file(paths.front())) {
+      if (stream || io_uring || direct || per_document) {
+        throw std::runtime_error("--stream, --io-uring, --direct and --per-document accept a single file");
+      }
+      Timer t; t.start();
+      auto tasks = io::plan_corpus({begin(paths), end(paths)}, batch_size, split_size);
+      auto result = count_corpus(tasks, threads, on_invalid, fold_case, encoding, tokenizer, by_word,
+                                 no_mmap ? io::MappedFile::Mode::Read : io::MappedFile::Mode::Map, chunk_size,
+                                 queue_depth);
+      t.stop();
+
+      size_t corpus_size = 0;
+      for (const auto &task : tasks) {
+        for (const auto &range : task) {
+          corpus_size += range.end - range.begin;
+        }
+      }
+      std::cout << "Corpus size: " << corpus_size << " bytes in " << tasks.size() << " tasks\n";
+      print_stats(result, t);
+      return 0;
+    }
+    const auto &file_path = paths.front();
 
-    uu::group_if(cbegin(input), cend(input), std::back_inserter(words),
-      [](auto&& rune) { return std::isalpha(rune) || is_russian(rune); },
-      [](auto word){ return word::Word{std::move(word)}; });
+    // Вектор на каждый документ: вывод идёт в stdout или --output, статистика - в stderr
+    if (per_document) {
+      if (io::detect_compression(std::filesystem::path{file_path}) != io::Compression::None) {
+        throw std::runtime_error("--per-document needs an uncompressed file");
+      }
+      if (by_word) {
+        throw std::runtime_error("--by-word does not apply to --per-document");
+      }
+      io::MappedFile file(file_path, no_mmap ? io::MappedFile::Mode::Read : io::MappedFile::Mode::Map);
+      std::ofstream output_file;
+      if (not output_path.empty()) {
+        output_file.open(output_path, std::ios::binary);
+        if (not output_file.is_open()) {
+          throw std::runtime_error("Failed to open output file: " + output_path);
+        }
+      }
+      auto &out = output_path.empty() ? std::cout : output_file;
 
-    word::Word empty_word {};
-    auto&& t1 = std::erase(words, empty_word);
+      Timer t; t.start();
+      auto documents = write_documents(file.view(), delimiter, threads, on_invalid, fold_case, encoding, tokenizer, out);
+      out.flush();
+      t.stop();
 
-    std::unordered_map<uint64_t, int> result;
+      std::cerr << "Documents: " << documents << "\n";
+      std::cerr << "Time: " << t.elapsed_ms() << '\n';
+      return 0;
+    }
 
-#define parallel1
-#ifdef parallel
-    Queue queue(1024);
+    // Сжатый файл распаковывается в отдельном потоке параллельно с подсчётом
+    if (auto compression = io::detect_compression(std::filesystem::path{file_path}); compression != io::Compression::None) {
+      if (io_uring || direct || no_mmap) {
+        throw std::runtime_error("--io-uring, --direct and --no-mmap do not apply to compressed input");
+      }
+      Timer t; t.start();
+      Counter result;
+      uu::EngineStats engine;
+      io::DecompressReader reader(file_path, compression, chunk_size, queue_depth);
+      auto consumed = count_stream(reader, result, on_invalid, fold_case, encoding, tokenizer, by_word, &engine);
+      t.stop();
+
+      std::cout << "Decompressed size: " << consumed << " bytes\n";
+      print_engine(engine);
+      print_stats(result, t);
+      return 0;
+    }
 
-    std::thread producer(produce, std::ref(queue), std::move(words));
-    std::thread consumer(consume, std::ref(queue), std::ref(result));
+    if (stream || io_uring || direct) {
+      Timer t; t.start();
+      Counter result;
+      uu::EngineStats engine;
+      size_t consumed = 0;
+      if (io_uring || direct) {
+        io::RingReader reader(file_path, chunk_size, queue_depth, direct);
+        if (not reader.async()) {
+          std::cerr << "io_uring is unavailable, falling back to pread\n";
+        }
+        if (direct && not reader.direct()) {
+          std::cerr << "O_DIRECT is unavailable, dropping read pages with posix_fadvise\n";
+        }
+        consumed = count_stream(reader, result, on_invalid, fold_case, encoding, tokenizer, by_word, &engine);
+      } else {
+        io::ChunkReader reader(file_path, chunk_size);
+        consumed = count_stream(reader, result, on_invalid, fold_case, encoding, tokenizer, by_word, &engine);
+      }
+      t.stop();
 
-    producer.join();
-    consumer.join();
-#else
-    for (;not empty(words); words.pop_back()) {
-      auto word = std::move(words.back());
-      // if (std::empty(word)) { continue; }
+      std::cout << "File size: " << consumed << " bytes\n";
+      print_engine(engine);
+      print_stats(result, t);
+      return 0;
+    }
+
+    // Отображаем файл в память (или читаем целиком, если mmap недоступен)
+    io::MappedFile file(file_path, no_mmap ? io::MappedFile::Mode::Read : io::MappedFile::Mode::Map);
+    auto input = file.view();
+    auto file_size = file.size();
+
+    // Выводим размер файла и декодер, выбранный по первым мегабайтам
+    std::cout << "File size: " << file_size << " bytes\n";
+    if (encoding == uu::Encoding::Utf8) {
+      print_engine(uu::prescan(input));
+    } else {
+      std::cout << "Encoding: " << uu::to_string(encoding) << '\n';
+    }
+
+    if (bench_repeats != 0) {
+      bench_decoder(input, bench_repeats);
+      return 0;
+    }
+    if (bench_views_repeats != 0) {
+      bench_views(input, bench_views_repeats);
+      return 0;
+    }
 
-      auto trigrams = generate_trigrams(std::move(word));
-      for (auto &[value] : trigrams) {
-        result[value]++;
+    // Проверка до подсчёта: корректный вход декодируется без проверок на каждом символе
+    bool validated = false;
+    if (validate) {
+      Timer t; t.start();
+      const auto invalid = uu::validate_utf8(input);
+      t.stop();
+      validated = invalid == input.size();
+      if (not validated && on_invalid == uu::OnInvalid::Stop) {
+        throw uu::InvalidUtf8(nullptr, invalid);
       }
-      /*
-      while (not empty(trigrams)) {
-        auto value = std::move(trigrams.back()); trigrams.pop_back();
-        result[value.value]++;
-      }*/
+      std::cout << "Validation: " << t.elapsed_ms() << " ms, "
+                << (validated ? "valid utf-8\n" : "invalid utf-8 at byte " + std::to_string(invalid) + "\n");
+    }
+
+    if (threads > 1) {
+      Timer t; t.start();
+      auto result = count_parallel(input, threads, on_invalid, fold_case, encoding, tokenizer, validated, by_word);
+      t.stop();
+      print_stats(result, t);
+      return 0;
+    }
+
+    Timer t; t.start();
+    Counter result;
+    if (pipeline) {
+      result = count_pipeline(input, on_invalid, fold_case, encoding, tokenizer, validated);
+    } else {
+      // Каждое слово сразу уходит в подсчёт: ни списка слов, ни векторов триграмм
+      count_words(result, tokenizer, by_word, [&](auto word_chars, auto sink) {
+        uu::for_each_group(cbegin(input), cend(input), word_chars, std::move(sink), on_invalid, fold_case, validated,
+                           encoding);
+      });
     }
-#endif
     t.stop();
-    std::cout << '\n';
-    std::cout << "Time: " << t.elapsed_ms() << '\n';
+    print_stats(result, t);
 
     /*
     for (const auto& [k, v] : result) {
@@ -0,0 +1,168 @@
+#include "group_if.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define UU_X86_64
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define UU_AARCH64
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+// Каждый вариант ядер - в своём пространстве имён (uu::scalar, uu::avx2, ...), тела компилируются
+// под свой набор инструкций атрибутом target, а не флагами всей единицы трансляции: иначе
+// инструкции AVX попали бы и в общие inline-функции, которые компоновщик мог бы выбрать для всех.
+
+#define UU_KERNEL_NAMESPACE scalar
+#include "simd_kernels.inc"
+#undef UU_KERNEL_NAMESPACE
+
+#if defined(UU_X86_64)
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.2,popcnt"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.2,popcnt")
+#endif
+#define UU_KERNEL_NAMESPACE sse42
+#define UU_KERNEL_SSE42
+#include "simd_kernels.inc"
+#undef UU_KERNEL_NAMESPACE
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,popcnt"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,popcnt")
+#endif
+#define UU_KERNEL_NAMESPACE avx2
+#define UU_KERNEL_AVX2
+#include "simd_kernels.inc"
+#undef UU_KERNEL_NAMESPACE
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx512bw,avx2,popcnt"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx2,popcnt")
+#endif
+#define UU_KERNEL_NAMESPACE avx512
+#define UU_KERNEL_AVX512
+#include "simd_kernels.inc"
+#undef UU_KERNEL_NAMESPACE
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#undef UU_KERNEL_SSE42
+#undef UU_KERNEL_AVX2
+#undef UU_KERNEL_AVX512
+
+#elif defined(UU_AARCH64)
+
+// Advanced SIMD входит в базовый набор ARMv8-A, атрибут target не нужен
+#define UU_KERNEL_NAMESPACE neon
+#define UU_KERNEL_NEON
+#include "simd_kernels.inc"
+#undef UU_KERNEL_NAMESPACE
+#undef UU_KERNEL_NEON
+
+#endif
+
+namespace {
+
+// Собранный вариант ядер для isa либо nullptr
+const uu::Kernels* variant(uu::Isa isa) noexcept {
+  switch (isa) {
+    case uu::Isa::Scalar: return &uu::scalar::table;
+#if defined(UU_X86_64)
+    case uu::Isa::Sse42: return &uu::sse42::table;
+    case uu::Isa::Avx2: return &uu::avx2::table;
+    case uu::Isa::Avx512: return &uu::avx512::table;
+#elif defined(UU_AARCH64)
+    case uu::Isa::Neon: return &uu::neon::table;
+#endif
+    default: return nullptr;
+  }
+}
+
+bool cpu_supports(uu::Isa isa) noexcept {
+#if defined(UU_X86_64) && (defined(__GNUC__) || defined(__clang__))
+  // cpuid с проверкой, что ОС сохраняет регистры AVX/AVX-512 (xgetbv)
+  __builtin_cpu_init();
+  switch (isa) {
+    case uu::Isa::Sse42: return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+    case uu::Isa::Avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    case uu::Isa::Avx512:
+      return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx2");
+    default: break;
+  }
+#elif defined(UU_AARCH64)
+  if (isa == uu::Isa::Neon) {
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+#else
+    return true;
+#endif
+  }
+#endif
+  return isa == uu::Isa::Scalar;
+}
+
+std::atomic<const uu::Kernels*> active{nullptr};
+
+} // namespace
+
+bool uu::isa_supported(Isa isa) noexcept {
+  return variant(isa) != nullptr && cpu_supports(isa);
+}
+
+uu::Isa uu::detect_isa() noexcept {
+  for (auto isa : {Isa::Avx512, Isa::Avx2, Isa::Sse42, Isa::Neon}) {
+    if (isa_supported(isa)) {
+      return isa;
+    }
+  }
+  return Isa::Scalar;
+}
+
+const uu::Kernels& uu::kernels() noexcept {
+  auto current = active.load(std::memory_order_acquire);
+  if (current == nullptr) [[unlikely]] {
+    // Гонка при первом вызове безопасна: все потоки выберут один и тот же вариант
+    current = variant(detect_isa());
+    active.store(current, std::memory_order_release);
+  }
+  return *current;
+}
+
+void uu::force_isa(Isa isa) {
+  if (not isa_supported(isa)) {
+    throw std::runtime_error(std::string(to_string(isa)) + " kernels are not available on this machine");
+  }
+  active.store(variant(isa), std::memory_order_release);
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// uu - Unicode Utilities
+namespace uu {
+
+/**
+ * @brief Множество ASCII-символов в виде, удобном для векторной классификации
+ *
+ * Символ c = 16 * h + l (h < 8) входит в множество, если в nibbles[l] установлен бит h.
+ * Такая таблица точно задаёт любое подмножество ASCII и проверяется двумя табличными
+ * подстановками по полубайтам (pshufb / tbl), см. classify_ascii64.
+ */
+struct AsciiSet {
+  std::array<uint8_t, 16> nibbles{};
+  std::array<uint64_t, 2> bits{};  // то же множество битовой картой для скалярной проверки
+
+  template<typename Predicate>
+  static AsciiSet from(Predicate&& pred) {
+    AsciiSet set;
+    for (uint32_t c = 0; c < 0x80; ++c) {
+      if (pred(c)) {
+        set.nibbles[c & 0x0F] |= static_cast<uint8_t>(1u << (c >> 4));
+        set.bits[c >> 6] |= uint64_t{1} << (c & 63);
+      }
+    }
+    return set;
+  }
+
+  [[nodiscard]] bool contains(uint8_t c) const noexcept { return (bits[(c >> 6) & 1] >> (c & 63)) & (c < 0x80); }
+};
+
+/**
+ * @brief Множество символов U+0000..U+07FF битовой картой
+ *
+ * Покрывает все символы, кодируемые в utf-8 одним или двумя байтами: ASCII, латиницу с диакритикой,
+ * греческий, кириллицу и т.д. Для таких блоков текста маска символов группы строится подстановкой
+ * без вызова предиката, см. group_code_points.
+ */
+struct TwoByteSet {
+  static constexpr uint32_t Limit = 0x800;
+
+  std::array<uint64_t, Limit / 64> bits{};
+
+  template<typename Predicate>
+  static TwoByteSet from(Predicate&& pred) {
+    TwoByteSet set;
+    for (uint32_t c = 0; c < Limit; ++c) {
+      if (pred(c)) {
+        set.bits[c >> 6] |= uint64_t{1} << (c & 63);
+      }
+    }
+    return set;
+  }
+
+  // Только для c < Limit
+  [[nodiscard]] bool contains(uint32_t c) const noexcept { return (bits[c >> 6] >> (c & 63)) & 1; }
+};
+
+namespace detail {
+
+// Бит h для старшего полубайта h < 8; байты >= 0x80 не классифицируются
+alignas(16) inline constexpr std::array<uint8_t, 16> HighNibbleBits{1, 2, 4, 8, 16, 32, 64, 128};
+
+inline uint64_t scalar_mask(const uint8_t* bytes, const AsciiSet& set) {
+  uint64_t letters = 0;
+  for (unsigned i = 0; i < 64; ++i) {
+    letters |= static_cast<uint64_t>(set.contains(bytes[i])) << i;
+  }
+  return letters;
+}
+
+// Маска из 64 байт 0/1: умножение собирает 8 младших битов байт слова в старший байт без переносов
+inline uint64_t flags_mask(const std::array<uint8_t, 64>& flags) {
+  uint64_t letters = 0;
+  for (unsigned i = 0; i < 8; ++i) {
+    uint64_t word;
+    std::memcpy(&word, flags.data() + 8 * i, sizeof(word));
+    letters |= (word * 0x0102040810204080ull) >> 56 << (8 * i);
+  }
+  return letters;
+}
+
+/**
+ * @brief Таблицы проверки utf-8 по полубайтам (J. Keiser, D. Lemire, "Validating UTF-8 In Less Than
+ *        One Instruction Per Byte")
+ *
+ * Каждый бит - вид ошибки. Для пары соседних байт (prev, byte) ошибка есть, если бит установлен
+ * во всех трёх подстановках: по старшему и младшему полубайту prev и по старшему полубайту byte.
+ * Оставшееся правило - второй и третий байт после ведущих E0..FF обязаны быть продолжениями -
+ * проверяется вычитанием с насыщением.
+ */
+namespace utf8_check {
+
+inline constexpr uint8_t TooShort = 1 << 0;      // ведущий байт или ASCII там, где нужно продолжение
+inline constexpr uint8_t TooLong = 1 << 1;       // продолжение после ASCII
+inline constexpr uint8_t Overlong3 = 1 << 2;     // E0 80..9F
+inline constexpr uint8_t TooLarge = 1 << 3;      // F4 90..BF, F5..FF
+inline constexpr uint8_t Surrogate = 1 << 4;     // ED A0..BF
+inline constexpr uint8_t Overlong2 = 1 << 5;     // C0, C1
+inline constexpr uint8_t TooLarge1000 = 1 << 6;  // F5..FF 80..8F
+inline constexpr uint8_t Overlong4 = 1 << 6;     // F0 80..8F
+inline constexpr uint8_t TwoConts = 1 << 7;      // продолжение после продолжения (проверяется отдельно)
+
+inline constexpr uint8_t Carry = TooShort | TooLong | TwoConts;
+
+alignas(16) inline constexpr std::array<uint8_t, 16> Byte1High{
+    TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,  // 0xxxxxxx
+    TwoConts, TwoConts, TwoConts, TwoConts,                                    // 10xxxxxx
+    TooShort | Overlong2,                                                      // 1100xxxx
+    TooShort,                                                                  // 1101xxxx
+    TooShort | Overlong3 | Surrogate,                                          // 1110xxxx
+    TooShort | TooLarge | TooLarge1000 | Overlong4};                           // 1111xxxx
+
+alignas(16) inline constexpr std::array<uint8_t, 16> Byte1Low{
+    Carry | Overlong3 | Overlong2 | Overlong4,  // ____0000
+    Carry | Overlong2,                          // ____0001
+    Carry, Carry,
+    Carry | TooLarge,                           // ____0100
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+    Carry | TooLarge | TooLarge1000 | Surrogate,  // ____1101
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000};
+
+alignas(16) inline constexpr std::array<uint8_t, 16> Byte2High{
+    TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,  // 0xxxxxxx
+    TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4,             // 1000xxxx
+    TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,                            // 1001xxxx
+    TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,                            // 1010xxxx
+    TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,                            // 1011xxxx
+    TooShort, TooShort, TooShort, TooShort};                                          // 11xxxxxx
+
+// Последние байты блока, начинающие символ, который блок не вмещает: вычитание с насыщением даёт не 0
+alignas(16) inline constexpr std::array<uint8_t, 16> IncompleteMax{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1};
+
+} // namespace utf8_check
+
+} // namespace detail
+
+/**
+ * @brief Набор инструкций, под который собран вариант векторных ядер (см. Kernels в group_if.h)
+ *
+ * Все варианты собираются в один исполняемый файл (simd.cpp), нужный выбирается при запуске
+ * по cpuid (x86) или hwcaps (aarch64).
+ */
+enum class Isa { Scalar, Sse42, Avx2, Avx512, Neon };
+
+constexpr std::string_view to_string(Isa isa) {
+  switch (isa) {
+    case Isa::Scalar: return "scalar";
+    case Isa::Sse42: return "sse4.2";
+    case Isa::Avx2: return "avx2";
+    case Isa::Avx512: return "avx512";
+    case Isa::Neon: return "neon";
+  }
+  return {};
+}
+
+/// true, если вариант ядер для isa собран и процессор его поддерживает
+[[nodiscard]] bool isa_supported(Isa isa) noexcept;
+
+/// Лучший набор инструкций, поддерживаемый процессором
+[[nodiscard]] Isa detect_isa() noexcept;
+
+} // namespace uu
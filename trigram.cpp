@@ -1,5 +1,113 @@
 #include "trigram.h"
 
-trigram::TextVector trigram::generate_trigrams(std::string_view text) {
+#include <algorithm>
+#include <initializer_list>
+#include <string_view>
 
-}
\ No newline at end of file
+void trigram::encode_utf8(uint32_t code_point, std::string& out) {
+  if (code_point <= 0x7F) {  // 1 байт
+    out.push_back(static_cast<char>(code_point));
+  } else if (code_point <= 0x7FF) {  // 2 байта
+    out.push_back(static_cast<char>(0xC0 | ((code_point >> 6) & 0x1F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point <= 0xFFFF) {  // 3 байта
+    out.push_back(static_cast<char>(0xE0 | ((code_point >> 12) & 0x0F)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point <= 0x10FFFF) {  // 4 байта
+    out.push_back(static_cast<char>(0xF0 | ((code_point >> 18) & 0x07)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+  // Игнорируем некорректные символы (по желанию можно добавить обработку ошибок)
+}
+
+namespace {
+
+uu::LetterSet letters{trigram::DefaultScripts};
+
+constexpr bool is_not_space(uu::UnicodeCodePoint code_point) { return code_point != U' '; }
+
+// Окна ngrams<3> слов текста ровно expected, а trigrams даёт столько же значений
+constexpr bool ngrams_match_trigrams(std::u32string_view text, std::initializer_list<std::u32string_view> expected) {
+  auto ngrams = text | uu::views::words(is_not_space) | uu::views::ngrams<3>;
+  auto window = ngrams.begin();
+  for (std::u32string_view ngram : expected) {
+    if (window == std::default_sentinel || not std::ranges::equal(*window, ngram)) {
+      return false;
+    }
+    ++window;
+  }
+  if (window != std::default_sentinel) {
+    return false;
+  }
+  auto trigrams = text | uu::views::words(is_not_space) | trigram::views::trigrams;
+  return std::ranges::distance(trigrams) == std::ssize(expected);
+}
+
+// Короткие слова: "␣w0␣" из одной буквы, "w0w1␣" из двух - как у for_each_trigram
+static_assert(ngrams_match_trigrams(U"a", {U" a "}));
+static_assert(ngrams_match_trigrams(U"ab", {U"ab "}));
+static_assert(ngrams_match_trigrams(U"abc", {U" ab", U"abc", U"bc "}));
+static_assert(ngrams_match_trigrams(U" a bc  def ghij ",
+                                    {U" a ", U"bc ", U" de", U"def", U"ef ", U" gh", U"ghi", U"hij", U"ij "}));
+
+} // namespace
+
+bool trigram::is_letter(uu::UnicodeCodePoint code_point) {
+  return letters(code_point);
+}
+
+void trigram::set_scripts(uu::ScriptSet scripts) {
+  letters = uu::LetterSet(scripts);
+}
+
+namespace {
+
+// Буферы потока для каждой политики: переживают вызов, поэтому в устойчивом режиме не выделяют память
+template<trigram::TokenizerPolicy Policy>
+std::vector<uint64_t>& collect_trigrams(std::string_view text, uu::OnInvalid policy, bool fold_case,
+                                        uu::Encoding encoding) {
+  thread_local std::vector<uint64_t> ids;
+  thread_local uu::GroupStream grouper(Policy{}, [](std::span<const uu::UnicodeCodePoint> word) {
+    trigram::for_each_trigram(word, [](uint64_t value) { ids.push_back(value); });
+  });
+
+  // Предыдущий вызов мог прерваться исключением посреди слова
+  grouper.reset();
+  ids.clear();
+  grouper.set_policy(policy);
+  grouper.set_fold_case(fold_case);
+  grouper.set_encoding(encoding);
+  grouper.feed(text);
+  grouper.finish();
+  return ids;
+}
+
+} // namespace
+
+trigram::TextVector trigram::generate_trigrams(std::string_view text, uu::OnInvalid policy, bool fold_case,
+                                               uu::Encoding encoding, Tokenizer tokenizer) {
+  auto& ids = visit(tokenizer, [&]<typename Policy>(Policy) -> std::vector<uint64_t>& {
+    return collect_trigrams<Policy>(text, policy, fold_case, encoding);
+  });
+  std::ranges::sort(ids);
+
+  size_t unique = 0;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    unique += i == 0 || ids[i] != ids[i - 1];
+  }
+  TextVector result;
+  result.ids.reserve(unique);
+  result.counts.reserve(unique);
+  for (auto value : ids) {
+    if (not result.ids.empty() && result.ids.back() == value) {
+      ++result.counts.back();
+    } else {
+      result.ids.push_back(value);
+      result.counts.push_back(1);
+    }
+  }
+  return result;
+}
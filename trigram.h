@@ -1,8 +1,314 @@
 #pragma once
 
+#include "group_if.h"
+#include "letters.h"
+#include "views.h"
+
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace trigram {
-  struct TextVector {};
-  TextVector generate_trigrams(std::string_view text);
-}
\ No newline at end of file
+
+void encode_utf8(uint32_t code_point, std::string& out);
+
+struct Trigram {
+  auto constexpr operator<=>(const Trigram &) const = default;
+  std::string to_utf8() const {
+    std::string result;
+
+    // Извлекаем 3 символа (21 бит каждый)
+    uint32_t char1 = (value >> 42) & 0x1FFFFF;  // Старшие 21 бит
+    uint32_t char2 = (value >> 21) & 0x1FFFFF;  // Средние 21 бит
+    uint32_t char3 = value & 0x1FFFFF;          // Младшие 21 бит
+
+    // Кодируем каждый символ в UTF-8 и добавляем в строку
+    encode_utf8(char1, result);
+    encode_utf8(char2, result);
+    encode_utf8(char3, result);
+
+    return result;
+  }
+  uint64_t value;
+};
+
+// Письменности слов по умолчанию
+inline constexpr uu::ScriptSet DefaultScripts{uu::Script::Latin, uu::Script::Cyrillic};
+
+// Символ слова: буква одной из письменностей, выбранных set_scripts (по умолчанию DefaultScripts)
+bool is_letter(uu::UnicodeCodePoint code_point);
+
+/**
+ * @brief Выбирает письменности, буквы которых составляют слова
+ *
+ * Вызывается до запуска потоков подсчёта: предикат читается без синхронизации.
+ */
+void set_scripts(uu::ScriptSet scripts);
+
+/**
+ * @brief Политика токенизатора: какие символы составляют слово
+ *
+ * Тип без состояния с предикатом на code point. Токенизатор получает политику параметром шаблона
+ * и специализируется под неё: ASCII-символы слова попадают в uu::AsciiSet векторного разбора,
+ * а проверка остальных встраивается в цикл декодирования.
+ */
+template<typename Policy>
+concept TokenizerPolicy = std::default_initializable<Policy> && std::predicate<const Policy&, uu::UnicodeCodePoint>;
+
+/**
+ * @brief Буквы (is_letter), при Digits - цифры ASCII, и постоянный набор дополнительных символов
+ *
+ * Свой набор собирается прямо из параметров: WordChars<false, '-', '\''> - слова с дефисом и апострофом.
+ */
+template<bool Digits, uu::UnicodeCodePoint... Extra>
+struct WordChars {
+  bool operator()(uu::UnicodeCodePoint code_point) const {
+    if constexpr (Digits) {
+      if (code_point - '0' < 10) { return true; }
+    }
+    return ((code_point == Extra) || ...) || is_letter(code_point);
+  }
+};
+
+// Только буквы - поведение по умолчанию
+using Letters = WordChars<false>;
+// Буквы и цифры
+using Alnum = WordChars<true>;
+// Идентификатор: буквы, цифры и подчёркивание
+using Identifier = WordChars<true, '_'>;
+// Буквы и апостроф, прямой и типографский (U+2019): "don't", "п’ять"
+using WithApostrophe = WordChars<false, '\'', 0x2019>;
+// Буквы и дефис-минус: "кто-то", "well-known"
+using WithHyphen = WordChars<false, '-'>;
+
+static_assert(TokenizerPolicy<Letters> && TokenizerPolicy<Identifier> && TokenizerPolicy<WithApostrophe>);
+
+/// Политика токенизатора, выбранная во время выполнения
+enum class Tokenizer { Letters, Alnum, Identifier, Apostrophe, Hyphen };
+
+/**
+ * @brief Вызывает visit с объектом политики tokenizer
+ *
+ * Единственное ветвление по выбору: дальше visit работает с конкретным типом политики,
+ * и весь разбор внутри него специализирован.
+ */
+template<typename Visitor>
+decltype(auto) visit(Tokenizer tokenizer, Visitor&& visitor) {
+  switch (tokenizer) {
+    case Tokenizer::Alnum: return visitor(Alnum{});
+    case Tokenizer::Identifier: return visitor(Identifier{});
+    case Tokenizer::Apostrophe: return visitor(WithApostrophe{});
+    case Tokenizer::Hyphen: return visitor(WithHyphen{});
+    case Tokenizer::Letters: break;
+  }
+  return visitor(Letters{});
+}
+
+/**
+ * @brief Передаёт visit значение каждой триграммы слова, ничего не выделяя
+ *
+ * @param word Непустое слово: индексируемая последовательность code points с size()
+ * @param visit Callable, принимающий uint64_t
+ */
+template<typename CodePoints, typename Visitor>
+void for_each_trigram(const CodePoints& word, Visitor&& visit) {
+  assert(not word.empty());
+
+  switch (auto size = word.size(); size) {
+    case 1: { // [_][w0][_]
+      auto trigram_value = (static_cast<uint64_t>(0x20) << 42) | 0x20;
+      trigram_value |= static_cast<uint64_t>(word[0]) << 21;
+      visit(trigram_value);
+      return;
+    }
+    case 2: { // [w0][w1][_]
+      auto trigram_value = static_cast<uint64_t>(0x20);
+      trigram_value |= static_cast<uint64_t>(word[0]) << 42;
+      trigram_value |= static_cast<uint64_t>(word[1]) << 21;
+      visit(trigram_value);
+      return;
+    }
+    default: {
+      for (size_t i = 0; i < size - 2; ++i) {
+        auto trigram_value = static_cast<uint64_t>(word[i]);
+        trigram_value |= static_cast<uint64_t>(word[i+1]) << 42;
+        trigram_value |= static_cast<uint64_t>(word[i+2]) << 21;
+        visit(trigram_value);
+      }
+      {
+        auto trigram_value = static_cast<uint64_t>(0x20);
+        trigram_value |= static_cast<uint64_t>(word[size-1]) << 42;
+        trigram_value |= static_cast<uint64_t>(word[size-2]) << 21;
+        visit(trigram_value);
+      }
+      {
+        auto trigram_value = static_cast<uint64_t>(0x20) << 42;
+        trigram_value |= static_cast<uint64_t>(word[0]) << 21;
+        trigram_value |= static_cast<uint64_t>(word[1]);
+        visit(trigram_value);
+      }
+    }
+  }
+}
+
+// Функция для извлечения триграмм из слова
+using Trigrams = std::vector<Trigram>;
+template<typename CodePoints>
+Trigrams generate_trigrams(const CodePoints& word) {
+  Trigrams result;
+  result.reserve(word.size());
+  for_each_trigram(word, [&result](uint64_t value) { result.emplace_back(value); });
+  return result;
+}
+
+namespace views {
+
+/**
+ * @brief Ленивые триграммы диапазона слов: те же значения, что передаёт for_each_trigram
+ *
+ * Слово читается один раз, без буфера: хватает трёх последних и двух первых code points.
+ */
+template<std::ranges::view V>
+  requires uu::views::detail::WordRange<V>
+class TrigramsView : public std::ranges::view_interface<TrigramsView<V>> {
+  using Outer = std::ranges::iterator_t<V>;
+
+public:
+  class iterator {
+  public:
+    using value_type = uint64_t;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::input_iterator_tag;
+
+    iterator() = default;
+    constexpr explicit iterator(V& base) : outer_(std::ranges::begin(base)), outer_end_(std::ranges::end(base)) { enter(); }
+    iterator(iterator&&) = default;
+    iterator& operator=(iterator&&) = default;
+
+    constexpr value_type operator*() const noexcept { return value_; }
+    constexpr iterator& operator++() {
+      if (phase_ == Phase::Inner && walker_.more(outer_)) [[likely]] {
+        shift(walker_.take(outer_));
+        return *this;
+      }
+      switch (phase_) {
+        case Phase::Inner: // [wn-2][wn-1][_]
+          value_ = static_cast<uint64_t>(0x20) | static_cast<uint64_t>(c_) << 42 | static_cast<uint64_t>(b_) << 21;
+          phase_ = Phase::Head;
+          break;
+        case Phase::Head: // [_][w0][w1]
+          value_ = static_cast<uint64_t>(0x20) << 42 | static_cast<uint64_t>(first_) << 21 | second_;
+          phase_ = Phase::Last;
+          break;
+        case Phase::Last:
+          ++outer_;
+          enter();
+          break;
+      }
+      return *this;
+    }
+    constexpr void operator++(int) { ++*this; }
+
+    friend constexpr bool operator==(const iterator& it, std::default_sentinel_t) noexcept { return it.done_; }
+
+  private:
+    enum class Phase { Inner, Head, Last };
+
+    // Первая триграмма очередного непустого слова
+    __attribute__((always_inline)) constexpr void enter() {
+      for (; outer_ != outer_end_; ++outer_) {
+        walker_.enter(outer_);
+        if (not walker_.more(outer_)) {
+          continue;
+        }
+        first_ = walker_.take(outer_);
+        if (not walker_.more(outer_)) { // [_][w0][_]
+          value_ = static_cast<uint64_t>(0x20) << 42 | static_cast<uint64_t>(first_) << 21 | 0x20;
+          phase_ = Phase::Last;
+          return;
+        }
+        second_ = walker_.take(outer_);
+        if (not walker_.more(outer_)) { // [w0][w1][_]
+          value_ = static_cast<uint64_t>(0x20) | static_cast<uint64_t>(first_) << 42 | static_cast<uint64_t>(second_) << 21;
+          phase_ = Phase::Last;
+          return;
+        }
+        b_ = first_;
+        c_ = second_;
+        shift(walker_.take(outer_));
+        phase_ = Phase::Inner;
+        return;
+      }
+      done_ = true;
+    }
+    // [wi][wi+1][wi+2]
+    constexpr void shift(uu::UnicodeCodePoint next) {
+      a_ = b_;
+      b_ = c_;
+      c_ = next;
+      value_ = static_cast<uint64_t>(a_) | static_cast<uint64_t>(b_) << 42 | static_cast<uint64_t>(c_) << 21;
+    }
+
+    Outer outer_{};
+    std::ranges::sentinel_t<V> outer_end_{};
+    uu::views::detail::WordWalker<Outer, std::remove_cvref_t<std::ranges::range_reference_t<V>>> walker_;
+    uu::UnicodeCodePoint first_ = 0, second_ = 0;
+    uu::UnicodeCodePoint a_ = 0, b_ = 0, c_ = 0;
+    uint64_t value_ = 0;
+    Phase phase_ = Phase::Last;
+    // Курсор words стоит в конце входа уже на последнем слове, поэтому конец - только после него
+    bool done_ = false;
+  };
+
+  constexpr explicit TrigramsView(V base) : base_(std::move(base)) {}
+
+  constexpr iterator begin() { return iterator(base_); }
+  constexpr std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  V base_;
+};
+
+/// text | uu::views::utf8_decode | uu::views::words(is_letter) | trigrams
+inline constexpr uu::views::detail::Closure trigrams{[]<typename R>(R&& range) {
+  return TrigramsView<std::views::all_t<R>>(std::views::all(std::forward<R>(range)));
+}};
+
+} // namespace views
+
+/**
+ * @brief Разреженный вектор триграмм одного документа
+ *
+ * ids отсортированы по возрастанию и уникальны, counts[i] - число вхождений ids[i].
+ */
+struct TextVector {
+  std::vector<uint64_t> ids;
+  std::vector<uint32_t> counts;
+
+  [[nodiscard]] size_t size() const noexcept { return ids.size(); }
+  [[nodiscard]] bool empty() const noexcept { return ids.empty(); }
+};
+
+/**
+ * @brief Строит вектор триграмм документа
+ *
+ * Слова выделяются так же, как при подсчёте по всему файлу (политикой tokenizer). Промежуточные буферы
+ * (текущее слово и список триграмм) у каждого потока свои и переиспользуются между вызовами,
+ * поэтому на документ приходятся только две точные аллокации результата.
+ *
+ * @param fold_case Приводить регистр: "Слово" и "слово" дают одни и те же триграммы
+ * @param encoding Кодировка text
+ * @param tokenizer Какие символы составляют слово
+ * @throws uu::InvalidUtf8 со смещением от начала text при uu::OnInvalid::Stop
+ */
+TextVector generate_trigrams(std::string_view text, uu::OnInvalid policy = uu::OnInvalid::Replace,
+                             bool fold_case = false, uu::Encoding encoding = uu::Encoding::Utf8,
+                             Tokenizer tokenizer = Tokenizer::Letters);
+
+} // namespace trigram
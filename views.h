@@ -0,0 +1,487 @@
+#pragma once
+
+#include "group_if.h"
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <utility>
+
+// uu - Unicode Utilities
+namespace uu {
+
+/// Символ, декодированный decode_utf8_char
+struct DecodedChar {
+  const uint8_t* next;         ///< начало следующего символа
+  UnicodeCodePoint code_point; ///< code point либо ReplacementCharacter
+  bool valid;                  ///< false - некорректная или оборванная последовательность
+};
+
+/**
+ * @brief Декодирует один символ utf-8 с позиции first < last
+ *
+ * Некорректная последовательность заменяется так же, как в decode_utf8_dfa: одна замена на
+ * максимальную корректную часть, а байт, прервавший последовательность, начинает следующий символ.
+ * Оборванная последовательность в конце входа - один некорректный символ до last.
+ */
+__attribute__((always_inline)) inline DecodedChar decode_utf8_char(const uint8_t* first, const uint8_t* last) {
+  if (*first < 0x80) [[likely]] {
+    return {first + 1, *first, true};
+  }
+  uint32_t state = Utf8Dfa::Accept;
+  UnicodeCodePoint code_point = 0;
+  for (auto pos = first; pos != last; ++pos) {
+    const auto type = Utf8Dfa::classes[*pos];
+    code_point = state != Utf8Dfa::Accept ? (*pos & 0x3Fu) | code_point << 6 : (0xFFu >> type) & *pos;
+    state = Utf8Dfa::transitions[state + type];
+    if (state == Utf8Dfa::Reject) [[unlikely]] {
+      return {pos + (pos == first), ReplacementCharacter, false};
+    }
+    if (state == Utf8Dfa::Accept) {
+      return {pos + 1, code_point, true};
+    }
+  }
+  return {last, ReplacementCharacter, false};
+}
+
+/**
+ * @brief Ленивые адаптеры диапазонов: байты utf-8 -> code points -> слова -> n-граммы
+ *
+ * Ничего не выделяют и не копируют вход; каждый шаг конвейера вычисляется при продвижении итератора:
+ * @code
+ * for (auto cp : text | uu::views::utf8_decode) { ... }
+ * for (auto word : text | uu::views::utf8_decode | uu::views::words(is_letter)) { ... }
+ * for (auto ngram : text | uu::views::utf8_decode | uu::views::words(is_letter) | uu::views::ngrams<3>) { ... }
+ * @endcode
+ *
+ * Скорость цикла вручную адаптерам не обещана: проверки конца слова и входа на каждом шаге
+ * компилятор не сливает. При -O2 (лучшее из 15, см. --bench-views) на input.txt конвейер и цикл
+ * равны (68 и 71 мс), на тексте из трёхбайтных символов конвейер медленнее (30 и 23 мс).
+ * Декодирование окнами по 64 байта через transcode_utf8 было медленнее посимвольного (98 и 93 мс,
+ * 53 и 38 мс по медиане), поэтому utf8_decode декодирует по символу. В горячих путях подсчёта
+ * используется for_each_group.
+ */
+namespace views {
+namespace detail {
+
+// Callable внутри представления: представление обязано быть movable, а лямбды не присваиваются
+template<typename T>
+class Box {
+public:
+  constexpr explicit Box(T value) : value_(std::move(value)) {}
+  Box(const Box&) = default;
+  Box(Box&&) = default;
+  constexpr Box& operator=(const Box& other) {
+    if (this != &other) {
+      value_.emplace(*other.value_);
+    }
+    return *this;
+  }
+  constexpr Box& operator=(Box&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+    if (this != &other) {
+      value_.emplace(std::move(*other.value_));
+    }
+    return *this;
+  }
+
+  constexpr const T& operator*() const noexcept { return *value_; }
+
+private:
+  std::optional<T> value_;
+};
+
+// Замыкание адаптера: range | closure == closure.adaptor(range)
+template<typename Adaptor>
+struct Closure {
+  Adaptor adaptor;
+
+  template<std::ranges::viewable_range R>
+  constexpr auto operator()(R&& range) const { return adaptor(std::forward<R>(range)); }
+
+  template<std::ranges::viewable_range R>
+  friend constexpr auto operator|(R&& range, const Closure& closure) { return closure.adaptor(std::forward<R>(range)); }
+};
+
+template<typename Adaptor>
+Closure(Adaptor) -> Closure<Adaptor>;
+
+} // namespace detail
+
+/// Code points байтового диапазона в utf-8; некорректные последовательности - по policy, как у group_if
+template<std::ranges::view V>
+  requires std::ranges::contiguous_range<V> && (sizeof(std::ranges::range_value_t<V>) == 1)
+class Utf8DecodeView : public std::ranges::view_interface<Utf8DecodeView<V>> {
+public:
+  class iterator {
+  public:
+    using value_type = UnicodeCodePoint;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::forward_iterator_tag;
+
+    iterator() = default;
+    iterator(const uint8_t* first, const uint8_t* last, OnInvalid policy)
+        : begin_(first), pos_(first), last_(last), policy_(policy) {
+      decode();
+    }
+
+    value_type operator*() const noexcept { return code_point_; }
+    iterator& operator++() {
+      pos_ = next_;
+      decode();
+      return *this;
+    }
+    iterator operator++(int) {
+      auto copy = *this;
+      ++*this;
+      return copy;
+    }
+
+    friend bool operator==(const iterator& lhs, const iterator& rhs) noexcept { return lhs.pos_ == rhs.pos_; }
+    friend bool operator==(const iterator& it, std::default_sentinel_t) noexcept { return it.pos_ == it.last_; }
+
+  private:
+    void decode() {
+      while (pos_ != last_) {
+        const auto [next, code_point, valid] = decode_utf8_char(pos_, last_);
+        if (valid || policy_ == OnInvalid::Replace) [[likely]] {
+          next_ = next;
+          code_point_ = code_point;
+          return;
+        }
+        if (policy_ == OnInvalid::Stop) {
+          invalid();
+        }
+        pos_ = next;
+      }
+    }
+    // Исключение - вне горячего цикла, иначе decode не встраивается в стадии конвейера
+    [[noreturn]] __attribute__((noinline)) void invalid() const { throw InvalidUtf8(pos_).at(begin_); }
+
+    const uint8_t* begin_ = nullptr;  // для смещения в InvalidUtf8
+    const uint8_t* pos_ = nullptr;
+    const uint8_t* next_ = nullptr;
+    const uint8_t* last_ = nullptr;
+    UnicodeCodePoint code_point_ = 0;
+    OnInvalid policy_ = OnInvalid::Replace;
+  };
+
+  Utf8DecodeView() = default;
+  Utf8DecodeView(V base, OnInvalid policy) : base_(std::move(base)), policy_(policy) {}
+
+  iterator begin() const {
+    const auto first = reinterpret_cast<const uint8_t*>(std::ranges::data(base_));
+    return {first, first + std::ranges::size(base_), policy_};
+  }
+  std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  V base_;
+  OnInvalid policy_ = OnInvalid::Replace;
+};
+
+template<typename R>
+Utf8DecodeView(R&&, OnInvalid) -> Utf8DecodeView<std::views::all_t<R>>;
+
+template<typename Cursor>
+class WordOf;
+
+/**
+ * @brief Группы подряд идущих элементов, удовлетворяющих pred; пустых групп нет
+ *
+ * Однопроходное, как std::views::lazy_split над input-диапазоном: слово читает элементы прямо
+ * курсором итератора words, так что каждый элемент читается (а code point декодируется) и
+ * проверяется pred один раз. Слово действительно до продвижения итератора, непрочитанный остаток
+ * слова при продвижении пропускается.
+ */
+template<std::ranges::view V, typename Pred>
+  requires std::ranges::input_range<V> && std::predicate<const Pred&, std::ranges::range_reference_t<V>>
+class WordsView : public std::ranges::view_interface<WordsView<V, Pred>> {
+public:
+  class iterator {
+  public:
+    using value_type = WordOf<iterator>;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::input_iterator_tag;
+
+    iterator() = default;
+    constexpr iterator(std::ranges::iterator_t<V> current, std::ranges::sentinel_t<V> end, const Pred& pred)
+        : current_(std::move(current)), end_(std::move(end)), pred_(&pred) {
+      check();
+      skip(false);
+    }
+    iterator(iterator&&) = default;
+    iterator& operator=(iterator&&) = default;
+
+    // Разыменование input-итератора - const, а слово продвигает его курсор. Итератор words не бывает
+    // константным объектом, а const_cast вместо mutable допускает constexpr и в GCC 12
+    constexpr value_type operator*() const { return value_type(const_cast<iterator&>(*this)); }
+    constexpr iterator& operator++() {
+      skip(true);
+      skip(false);
+      return *this;
+    }
+    constexpr void operator++(int) { ++*this; }
+
+    friend constexpr bool operator==(const iterator& it, std::default_sentinel_t) { return it.current_ == it.end_; }
+
+    // Курсор по элементам текущего слова: им читают слово WordOf и стадии конвейера после words
+    [[nodiscard]] constexpr bool in_word() const noexcept { return in_word_; }
+    [[nodiscard]] constexpr decltype(auto) current() const { return *current_; }
+    constexpr void advance() {
+      ++current_;
+      check();
+    }
+
+  private:
+    // pred вычисляется один раз на элемент, при переходе к нему
+    constexpr void check() { in_word_ = current_ != end_ && std::invoke(*pred_, *current_); }
+    // Пропускает элементы, для которых pred == in_word
+    constexpr void skip(bool in_word) {
+      while (in_word_ == in_word && current_ != end_) {
+        advance();
+      }
+    }
+
+    std::ranges::iterator_t<V> current_{};
+    bool in_word_ = false;
+    std::ranges::sentinel_t<V> end_{};
+    const Pred* pred_ = nullptr;
+  };
+
+  constexpr WordsView(V base, Pred pred) : base_(std::move(base)), pred_(std::move(pred)) {}
+
+  constexpr iterator begin() { return {std::ranges::begin(base_), std::ranges::end(base_), *pred_}; }
+  constexpr std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  V base_;
+  detail::Box<Pred> pred_;
+};
+
+template<typename R, typename Pred>
+WordsView(R&&, Pred) -> WordsView<std::views::all_t<R>, Pred>;
+
+/// Слово WordsView: элементы под курсором итератора words, пока они удовлетворяют pred
+template<typename Cursor>
+class WordOf : public std::ranges::view_interface<WordOf<Cursor>> {
+public:
+  class iterator {
+  public:
+    using value_type = std::remove_cvref_t<decltype(std::declval<const Cursor&>().current())>;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::input_iterator_tag;
+
+    iterator() = default;
+    constexpr explicit iterator(Cursor& cursor) : cursor_(&cursor) {}
+
+    constexpr decltype(auto) operator*() const { return cursor_->current(); }
+    constexpr iterator& operator++() {
+      cursor_->advance();
+      return *this;
+    }
+    constexpr void operator++(int) { ++*this; }
+
+    friend constexpr bool operator==(const iterator& it, std::default_sentinel_t) { return not it.cursor_->in_word(); }
+
+  private:
+    Cursor* cursor_ = nullptr;
+  };
+
+  WordOf() = default;
+  constexpr explicit WordOf(Cursor& cursor) : cursor_(&cursor) {}
+
+  constexpr iterator begin() const { return iterator(*cursor_); }
+  constexpr std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  Cursor* cursor_ = nullptr;
+};
+
+namespace detail {
+
+// Итератор диапазона слов, сам читающий символы текущего слова (итератор words)
+template<typename Outer>
+concept WordCursor = requires(Outer& outer) {
+  { outer.in_word() } -> std::convertible_to<bool>;
+  outer.current();
+  outer.advance();
+};
+
+// Чтение символов текущего слова для стадий после words. Общий случай держит итераторы слова,
+// поэтому слова - заимствованные диапазоны (span, subrange)
+template<typename Outer, typename Word>
+class WordWalker {
+public:
+  constexpr void enter(const Outer& outer) {
+    auto&& word = *outer;
+    inner_ = std::ranges::begin(word);
+    inner_end_ = std::ranges::end(word);
+  }
+  [[nodiscard]] constexpr bool more(const Outer&) const { return inner_ != inner_end_; }
+  constexpr UnicodeCodePoint take(const Outer&) {
+    const UnicodeCodePoint code_point = *inner_;
+    ++inner_;
+    return code_point;
+  }
+
+private:
+  std::ranges::iterator_t<Word> inner_{};
+  std::ranges::sentinel_t<Word> inner_end_{};
+};
+
+// За словами words стадия читает курсор внешнего итератора: всё состояние конвейера хранится по
+// значению в одном итераторе, и компилятор держит его в регистрах, как в написанном вручную цикле
+template<typename Outer, typename Word>
+  requires WordCursor<Outer>
+class WordWalker<Outer, Word> {
+public:
+  constexpr void enter(const Outer&) {}
+  [[nodiscard]] constexpr bool more(const Outer& outer) const { return outer.in_word(); }
+  constexpr UnicodeCodePoint take(Outer& outer) {
+    const UnicodeCodePoint code_point = outer.current();
+    outer.advance();
+    return code_point;
+  }
+};
+
+// Слова, которые можно читать WordWalker
+template<typename V>
+concept WordRange = std::ranges::input_range<V> && std::ranges::input_range<std::ranges::range_reference_t<V>> &&
+                    (WordCursor<std::ranges::iterator_t<V>> ||
+                     std::ranges::borrowed_range<std::ranges::range_reference_t<V>>);
+
+} // namespace detail
+
+/**
+ * @brief N-граммы каждого слова диапазона слов, дополненного пробелом с обеих сторон
+ *
+ * Слово w длины n >= N даёт n + 3 - N окон std::array<UnicodeCodePoint, N> строки " w "; для N = 3
+ * это "␣w0w1", ..., "wn-2wn-1␣". Слово из N - 1 символов, как у for_each_trigram, даёт одно окно
+ * "w␣", из N - 2 - одно окно "␣w␣", слова короче окон не дают. Поэтому ngrams<3> и
+ * trigram::views::trigrams дают одинаковое число окон на любом слове.
+ */
+template<std::ranges::view V, size_t N>
+  requires detail::WordRange<V>
+class NgramsView : public std::ranges::view_interface<NgramsView<V, N>> {
+  static_assert(N >= 2, "an n-gram spans at least a letter and the padding");
+
+  using Outer = std::ranges::iterator_t<V>;
+
+public:
+  class iterator {
+  public:
+    using value_type = std::array<UnicodeCodePoint, N>;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::input_iterator_tag;
+
+    iterator() = default;
+    constexpr explicit iterator(V& base) : outer_(std::ranges::begin(base)), outer_end_(std::ranges::end(base)) { enter(); }
+    iterator(iterator&&) = default;
+    iterator& operator=(iterator&&) = default;
+
+    constexpr const value_type& operator*() const noexcept { return window_; }
+    constexpr iterator& operator++() {
+      std::shift_left(window_.begin(), window_.end(), 1);
+      if (not pull(window_[N - 1])) {
+        ++outer_;
+        enter();
+      }
+      return *this;
+    }
+    constexpr void operator++(int) { ++*this; }
+
+    friend constexpr bool operator==(const iterator& it, std::default_sentinel_t) noexcept { return it.done_; }
+
+  private:
+    // Первое окно очередного слова, в котором хватает символов
+    __attribute__((always_inline)) constexpr void enter() {
+      for (; outer_ != outer_end_; ++outer_) {
+        walker_.enter(outer_);
+        padded_ = false;
+        window_[0] = U' ';
+        size_t filled = 1;
+        while (filled < N && pull(window_[filled])) {
+          ++filled;
+        }
+        if (filled == N) {
+          if (not padded_ && not walker_.more(outer_)) { // n == N - 1: только "w␣"
+            std::shift_left(window_.begin(), window_.end(), 1);
+            pull(window_[N - 1]);
+          }
+          return;
+        }
+      }
+      done_ = true;
+    }
+    // Следующий символ строки " w ": символы слова, затем завершающий пробел
+    constexpr bool pull(UnicodeCodePoint& code_point) {
+      if (walker_.more(outer_)) {
+        code_point = walker_.take(outer_);
+        return true;
+      }
+      if (not padded_) {
+        padded_ = true;
+        code_point = U' ';
+        return true;
+      }
+      return false;
+    }
+
+    Outer outer_{};
+    std::ranges::sentinel_t<V> outer_end_{};
+    detail::WordWalker<Outer, std::remove_cvref_t<std::ranges::range_reference_t<V>>> walker_;
+    bool padded_ = false;
+    // Курсор words стоит в конце входа уже на последнем слове, поэтому конец - только после него
+    bool done_ = false;
+    value_type window_{};
+  };
+
+  constexpr explicit NgramsView(V base) : base_(std::move(base)) {}
+
+  constexpr iterator begin() { return iterator(base_); }
+  constexpr std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+  V base_;
+};
+
+/// text | utf8_decode, text | utf8_decode(OnInvalid::Skip)
+struct Utf8DecodeAdaptor {
+  OnInvalid policy = OnInvalid::Replace;
+
+  template<std::ranges::viewable_range R>
+  constexpr auto operator()(R&& range) const { return Utf8DecodeView(std::views::all(std::forward<R>(range)), policy); }
+  constexpr Utf8DecodeAdaptor operator()(OnInvalid on_invalid) const { return {on_invalid}; }
+
+  template<std::ranges::viewable_range R>
+  friend constexpr auto operator|(R&& range, const Utf8DecodeAdaptor& adaptor) { return adaptor(std::forward<R>(range)); }
+};
+
+inline constexpr Utf8DecodeAdaptor utf8_decode;
+
+/// code_points | words(pred)
+template<typename Pred>
+constexpr auto words(Pred pred) {
+  return detail::Closure{[pred = std::move(pred)]<typename R>(R&& range) {
+    return WordsView(std::views::all(std::forward<R>(range)), pred);
+  }};
+}
+
+/// words | ngrams<N>
+template<size_t N>
+inline constexpr detail::Closure ngrams{[]<typename R>(R&& range) {
+  return NgramsView<std::views::all_t<R>, N>(std::views::all(std::forward<R>(range)));
+}};
+
+} // namespace views
+} // namespace uu
+
+// Итераторы слова ссылаются на итератор words, а не на само слово
+template<typename Cursor>
+inline constexpr bool std::ranges::enable_borrowed_range<uu::views::WordOf<Cursor>> = true;
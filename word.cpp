@@ -1,6 +1,8 @@
 #include "word.h"
 
+#include <limits>
 #include <ostream>
+#include <stdexcept>
 
 word::Word::Word(std::vector<code_point>&& word): word_(std::move(word)) {}
 word::Word::Word() {}
@@ -40,4 +42,48 @@ std::ostream& word::operator<<(std::ostream& os, const word::Word& word) {
 
 [[nodiscard]] bool word::Word::empty() const noexcept { return word_.empty(); }
 
-[[nodiscard]] size_t word::Word::size() const noexcept { return word_.size(); }
\ No newline at end of file
+[[nodiscard]] size_t word::Word::size() const noexcept { return word_.size(); }
+
+word::WordTable::WordTable(size_t input_size) {
+  // Резерв по оценке, а не по верхней границе (слово на каждые 2 байта): та занимала бы около 10 байт
+  // адресного пространства на байт входа, и на многогигабайтном файле reserve бросал бы bad_alloc.
+  // Code points слов не больше, чем байт, а слово в тексте - в среднем от 6 байт с разделителем;
+  // если оценка мала, векторы растут как обычно
+  buffer_.reserve(input_size);
+  offsets_.reserve(input_size / 6 + 1);
+  lengths_.reserve(input_size / 6 + 1);
+}
+
+void word::WordTable::push_back(const uu::WordSpan& word) {
+  if (word.size > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("Word of " + std::to_string(word.size) + " code points is too long");
+  }
+  offsets_.push_back(word.offset);
+  lengths_.push_back(static_cast<uint32_t>(word.size));
+}
+
+word::WordCounter::WordCounter() : slots_(1 << 12), mask_(slots_.size() - 1) {}
+
+void word::WordCounter::insert(Slot& slot, uint64_t hash, View word) {
+  slot = {hash, buffer_.size(), 1, word.size()};
+  buffer_.insert(buffer_.end(), word.begin(), word.end());
+  // Заполнение не выше половины: цепочки пробирования остаются короткими
+  if (++size_ * 2 > slots_.size()) {
+    grow();
+  }
+}
+
+void word::WordCounter::grow() {
+  std::vector<Slot> slots(slots_.size() * 2);
+  const auto mask = slots.size() - 1;
+  for (const auto& slot : slots_) {
+    if (slot.count == 0) { continue; }
+    auto pos = slot.hash & mask;
+    while (slots[pos].count != 0) {
+      pos = (pos + 1) & mask;
+    }
+    slots[pos] = slot;
+  }
+  slots_.swap(slots);
+  mask_ = mask;
+}
@@ -1,5 +1,13 @@
 #pragma once
 
+#include "group_if.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <string>
 #include <vector>
 
 namespace word {
@@ -28,4 +36,118 @@ private:
 
 std::ostream& operator<<(std::ostream& os, const Word& word);
 
+/**
+ * @brief Слова текста в плоских массивах
+ *
+ * Code points всех слов лежат подряд в одном буфере, а смещение и длина каждого слова - в двух
+ * отдельных массивах. Слово стоит 12 байт сверх своих code points вместо 64-байтного Word и
+ * отдельного блока в куче. Заполняется uu::group_spans:
+ * @code
+ * word::WordTable words(input.size());
+ * uu::group_spans(cbegin(input), cend(input), words.buffer(), std::back_inserter(words), is_letter);
+ * @endcode
+ */
+class WordTable {
+public:
+  using code_point = Word::code_point;
+  using value_type = uu::WordSpan;
+  // Code points слова
+  using View = std::span<const code_point>;
+
+  WordTable() = default;
+  // Резервирует место под слова текста из input_size байт по оценке их числа
+  explicit WordTable(size_t input_size);
+
+  // Буфер, в который токенизатор дописывает code points слов
+  [[nodiscard]] std::vector<code_point>& buffer() noexcept { return buffer_; }
+  void push_back(const uu::WordSpan& word);
+
+  [[nodiscard]] View operator[](size_t pos) const noexcept { return {buffer_.data() + offsets_[pos], lengths_[pos]}; }
+  [[nodiscard]] size_t size() const noexcept { return offsets_.size(); }
+  [[nodiscard]] bool empty() const noexcept { return offsets_.empty(); }
+
+private:
+  std::vector<code_point> buffer_;
+  std::vector<uint64_t> offsets_;
+  std::vector<uint32_t> lengths_;
+};
+
+/**
+ * @brief Частоты различных слов текста
+ *
+ * Открытая адресация с линейным пробированием: слот хранит хэш, смещение и длину слова в общем
+ * буфере code points и число его вхождений. Повторное слово стоит хэша и одного сравнения, а
+ * code points копируются только при первой встрече. Текст подчиняется закону Ципфа, поэтому
+ * различных слов на порядки меньше, чем вхождений:
+ * @code
+ * word::WordCounter words;
+ * uu::for_each_group(cbegin(input), cend(input), is_letter, [&](auto word) { words.add(word); });
+ * words.for_each([&](word::WordCounter::View word, size_t count) { ... });
+ * @endcode
+ */
+class WordCounter {
+public:
+  using code_point = Word::code_point;
+  using View = std::span<const code_point>;
+
+  WordCounter();
+
+  // Учитывает одно вхождение слова
+  void add(View word) {
+    const auto hash = hash_of(word);
+    for (auto pos = hash & mask_;; pos = (pos + 1) & mask_) {
+      auto& slot = slots_[pos];
+      if (slot.count == 0) {
+        insert(slot, hash, word);
+        return;
+      }
+      if (slot.hash == hash && slot.length == word.size() &&
+          std::equal(word.begin(), word.end(), buffer_.data() + slot.offset)) {
+        ++slot.count;
+        return;
+      }
+    }
+  }
+
+  // Вызывает visit(View, size_t count) для каждого различного слова
+  template<typename Visit>
+  void for_each(Visit visit) const {
+    for (const auto& slot : slots_) {
+      if (slot.count != 0) {
+        visit(View{buffer_.data() + slot.offset, slot.length}, static_cast<size_t>(slot.count));
+      }
+    }
+  }
+
+  // Число различных слов
+  [[nodiscard]] size_t size() const noexcept { return size_; }
+  [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+private:
+  struct Slot {
+    uint64_t hash = 0;
+    uint64_t offset = 0;
+    uint64_t count = 0;  // 0 - слот свободен
+    uint64_t length = 0;
+  };
+
+  static uint64_t hash_of(View word) noexcept {
+    uint64_t hash = word.size();
+    for (auto code_point : word) {
+      hash = (hash ^ code_point) * 0x9E3779B97F4A7C15ull;
+    }
+    // Младшие биты произведения зависят лишь от младших битов множителей, а слот выбирают именно они
+    hash ^= hash >> 32;
+    return hash ^ (hash >> 17);
+  }
+
+  void insert(Slot& slot, uint64_t hash, View word);
+  void grow();
+
+  std::vector<code_point> buffer_;
+  std::vector<Slot> slots_;
+  size_t mask_ = 0;
+  size_t size_ = 0;
+};
+
 } // namespace word
\ No newline at end of file